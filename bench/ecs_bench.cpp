@@ -0,0 +1,687 @@
+//Micro and macro benchmarks of the containers and registries, the JSON output follows
+//the Google Benchmark layout so runs of different commits can be compared with its tools.
+//
+//  ecs_bench [--benchmark_filter=<substring>] [--benchmark_out=<file.json>]
+//            [--benchmark_min_time=<seconds>] [--benchmark_max_size=<elements>]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "registry.h"
+#include "archetype.h"
+
+namespace bench
+{
+	//Accumulates the time spent between start and stop, setup outside of it is not measured
+	class Timer
+	{
+	public:
+		void start()
+		{
+			wall_start = std::chrono::steady_clock::now();
+			cpu_start = std::clock();
+		}
+
+		void stop()
+		{
+			wall_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall_start).count();
+			cpu_ns += (std::clock() - cpu_start) * (1e9 / CLOCKS_PER_SEC);
+		}
+
+		double wall_ns = 0.0, cpu_ns = 0.0;
+
+	private:
+		std::chrono::steady_clock::time_point wall_start;
+		std::clock_t cpu_start = 0;
+	};
+
+	struct Result
+	{
+		std::string name;
+		u64 iterations;
+		double real_time, cpu_time;
+		double items_per_second;
+	};
+
+	struct Options
+	{
+		std::string filter;
+		std::string out;
+		double min_time = 0.5;
+		u64 max_size = 10000000;
+	};
+
+	class Runner
+	{
+	public:
+		explicit Runner(const Options& options) : options{options} {}
+
+		//body measures one iteration processing items elements
+		void run(const std::string& name, u64 items, const std::function<void(Timer&)>& body)
+		{
+			if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+				return;
+
+			Timer timer;
+			u64 iterations = 0;
+			do {
+				body(timer);
+				++iterations;
+			} while (timer.wall_ns < options.min_time * 1e9 && iterations < MAX_ITERATIONS);
+
+			Result result{ name, iterations, timer.wall_ns / iterations, timer.cpu_ns / iterations,
+				timer.wall_ns > 0.0 ? items * iterations / (timer.wall_ns * 1e-9) : 0.0 };
+			std::printf("%-64s %14.0f ns %14.0f ns %10llu %12.3fM items/s\n", result.name.c_str(), result.real_time,
+				result.cpu_time, static_cast<unsigned long long>(result.iterations), result.items_per_second * 1e-6);
+			std::fflush(stdout);
+			results.push_back(result);
+		}
+
+		bool enabled(u64 size) const
+		{
+			return size <= options.max_size;
+		}
+
+		bool write_json() const
+		{
+			if (options.out.empty())
+				return true;
+
+			FILE* file = std::fopen(options.out.c_str(), "w");
+			if (file == nullptr)
+				return false;
+
+			char date[64];
+			const std::time_t now = std::time(nullptr);
+			std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+			std::fprintf(file, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": \"ecs_bench\",\n", date);
+			std::fprintf(file, "    \"min_time\": %f,\n    \"max_size\": %llu\n  },\n  \"benchmarks\": [\n", options.min_time,
+				static_cast<unsigned long long>(options.max_size));
+			for (size_t i = 0; i < results.size(); i++) {
+				const Result& result = results[i];
+				std::fprintf(file, "    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n      \"run_type\": \"iteration\",\n",
+					result.name.c_str(), result.name.c_str());
+				std::fprintf(file, "      \"iterations\": %llu,\n      \"real_time\": %f,\n      \"cpu_time\": %f,\n",
+					static_cast<unsigned long long>(result.iterations), result.real_time, result.cpu_time);
+				std::fprintf(file, "      \"time_unit\": \"ns\",\n      \"items_per_second\": %f\n    }%s\n",
+					result.items_per_second, i + 1 < results.size() ? "," : "");
+			}
+
+			std::fprintf(file, "  ]\n}\n");
+			std::fclose(file);
+			return true;
+		}
+
+	private:
+		static constexpr u64 MAX_ITERATIONS = 1000000;
+
+		Options options;
+		std::vector<Result> results;
+	};
+
+	enum class Pattern { Sequential, Random };
+
+	const char* pattern_name(Pattern pattern)
+	{
+		return pattern == Pattern::Sequential ? "sequential" : "random";
+	}
+
+	std::vector<u64> make_keys(u64 count, Pattern pattern)
+	{
+		std::vector<u64> keys(count);
+		for (u64 i = 0; i < count; i++)
+			keys[i] = i;
+
+		if (pattern == Pattern::Random) {
+			std::mt19937_64 engine{ 0x5EED };
+			std::shuffle(keys.begin(), keys.end(), engine);
+		}
+
+		return keys;
+	}
+
+	std::string label(const char* family, const char* operation, Pattern pattern, u64 size)
+	{
+		return std::string(family) + "/" + operation + "/" + pattern_name(pattern) + "/" + std::to_string(size);
+	}
+
+	//Keeps the optimizer from discarding the measured work
+	volatile u64 sink = 0;
+
+	const u64 CONTAINER_SIZES[] = { 1000, 10000, 100000, 1000000, 10000000 };
+	const u64 REGISTRY_SIZES[] = { 1000, 10000, 100000, 1000000 };
+	const Pattern PATTERNS[] = { Pattern::Sequential, Pattern::Random };
+}
+
+using namespace bench;
+
+template<u32 I> struct DenseComponent { u64 value; f32 padding[2]; };
+template<u32 I> struct SparseComponent { u64 value; f32 padding[2]; };
+
+template<u32 I>
+struct StorageTraits<SparseComponent<I>>
+{
+	using MapType = SparseSet<SparseComponent<I>>;
+};
+
+template<u32 I> struct TransientComponent { u64 value; f32 padding[2]; };
+
+template<u32 I>
+struct StorageTraits<TransientComponent<I>>
+{
+	using MapType = TransientSet<TransientComponent<I>>;
+};
+
+static void bench_bucket_allocator(Runner& runner)
+{
+	using Node = TreeNode<u64, u64>;
+	for (u64 size : CONTAINER_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		for (Pattern pattern : PATTERNS) {
+			const std::vector<u64> order = make_keys(size, pattern);
+			runner.run(label("BucketAllocator", "allocate_free", pattern, size), size * 2, [&](Timer& timer) {
+				BucketAllocator<Node> alloc;
+				std::vector<void*> memory(size);
+				timer.start();
+				for (u64 i = 0; i < size; i++)
+					memory[i] = alloc.allocate_new();
+				for (u64 i : order)
+					alloc.free(memory[i]);
+				timer.stop();
+			});
+		}
+	}
+}
+
+//DenseMap and SparseSet iterators dereference to the value, the std ones to a pair
+template<class Iterator>
+static u64 value_of(Iterator& it)
+{
+	if constexpr (std::is_same_v<std::decay_t<decltype(*it)>, u64>)
+		return *it;
+	else
+		return it->second;
+}
+
+template<class Map>
+static void bench_ordered_insert_find_erase(Runner& runner, const char* family)
+{
+	for (u64 size : CONTAINER_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		for (Pattern pattern : PATTERNS) {
+			const std::vector<u64> keys = make_keys(size, pattern);
+			runner.run(label(family, "insert", pattern, size), size, [&](Timer& timer) {
+				Map map;
+				timer.start();
+				for (u64 key : keys)
+					map.emplace(key, key);
+				timer.stop();
+			});
+
+			Map filled;
+			for (u64 key : keys)
+				filled.emplace(key, key);
+
+			runner.run(label(family, "find", pattern, size), size, [&](Timer& timer) {
+				u64 sum = 0;
+				timer.start();
+				for (u64 key : keys)
+					sum += filled.find(key) != filled.end();
+				timer.stop();
+				sink = sum;
+			});
+
+			runner.run(label(family, "erase", pattern, size), size, [&](Timer& timer) {
+				Map map;
+				for (u64 key : keys)
+					map.emplace(key, key);
+				timer.start();
+				for (u64 key : keys)
+					map.erase(key);
+				timer.stop();
+			});
+
+			runner.run(label(family, "iterate", pattern, size), size, [&](Timer& timer) {
+				u64 sum = 0;
+				timer.start();
+				for (auto it = filled.begin(); it != filled.end(); ++it)
+					sum += value_of(it);
+				timer.stop();
+				sink = sum;
+			});
+		}
+	}
+}
+
+//The red black tree is benchmarked through DenseMap, which adds no work over it
+static void bench_containers(Runner& runner)
+{
+	bench_ordered_insert_find_erase<DenseMap<u64, u64>>(runner, "DenseMap");
+	bench_ordered_insert_find_erase<DenseMap<u64, u64, InlineTreeNode>>(runner, "DenseMap<InlineTreeNode>");
+	bench_ordered_insert_find_erase<DenseMap<u64, u64, ThreadedInlineTreeNode>>(runner, "DenseMap<ThreadedInlineTreeNode>");
+	bench_ordered_insert_find_erase<BTreeMap<u64, u64>>(runner, "BTreeMap");
+	bench_ordered_insert_find_erase<SparseSet<u64>>(runner, "SparseSet");
+	bench_ordered_insert_find_erase<FlatMap<u64, u64>>(runner, "FlatMap");
+	bench_ordered_insert_find_erase<std::map<u64, u64>>(runner, "std::map");
+	bench_ordered_insert_find_erase<std::unordered_map<u64, u64>>(runner, "std::unordered_map");
+
+	for (u64 size : CONTAINER_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		const std::vector<u64> keys = make_keys(size, Pattern::Sequential);
+		runner.run(label("DenseMap", "emplace_sorted", Pattern::Sequential, size), size, [&](Timer& timer) {
+			DenseMap<u64, u64> map;
+			timer.start();
+			map.emplace_sorted(keys.begin(), keys.end(), u64{ 1 });
+			timer.stop();
+		});
+
+		runner.run(label("BTreeMap", "emplace_sorted", Pattern::Sequential, size), size, [&](Timer& timer) {
+			BTreeMap<u64, u64> map;
+			timer.start();
+			map.emplace_sorted(keys.begin(), keys.end(), u64{ 1 });
+			timer.stop();
+		});
+
+		runner.run(label("DenseMap", "erase_sorted", Pattern::Sequential, size), size, [&](Timer& timer) {
+			DenseMap<u64, u64> map;
+			map.emplace_sorted(keys.begin(), keys.end(), u64{ 1 });
+			timer.start();
+			map.erase_sorted(keys.begin(), keys.end());
+			timer.stop();
+		});
+
+		runner.run(label("DenseMap", "clear", Pattern::Sequential, size), size, [&](Timer& timer) {
+			DenseMap<u64, u64> map;
+			map.emplace_sorted(keys.begin(), keys.end(), u64{ 1 });
+			timer.start();
+			map.clear();
+			timer.stop();
+		});
+	}
+}
+
+template<template<u32> class Component, u32... I>
+static void bench_registry_family(Runner& runner, const char* family, u64 size, Pattern pattern, std::integer_sequence<u32, I...>)
+{
+	const std::string name = std::string("Registry<") + family + ">";
+	const std::string types = std::to_string(sizeof...(I)) + "types";
+	const std::vector<u64> order = make_keys(size, pattern);
+
+	auto populate = [&](Registry& registry, std::vector<u64>& entities) {
+		entities.resize(size);
+		for (u64 i = 0; i < size; i++)
+			entities[i] = registry.create_entity();
+		for (u64 i : order)
+			(registry.add_component<Component<I>>(entities[i], Component<I>{ i }), ...);
+	};
+
+	runner.run(label(name.c_str(), ("add/" + types).c_str(), pattern, size), size * sizeof...(I), [&](Timer& timer) {
+		Registry registry;
+		std::vector<u64> entities(size);
+		for (u64 i = 0; i < size; i++)
+			entities[i] = registry.create_entity();
+		timer.start();
+		for (u64 i : order)
+			(registry.add_component<Component<I>>(entities[i], Component<I>{ i }), ...);
+		timer.stop();
+	});
+
+	Registry filled;
+	std::vector<u64> entities;
+	populate(filled, entities);
+
+	runner.run(label(name.c_str(), ("get/" + types).c_str(), pattern, size), size * sizeof...(I), [&](Timer& timer) {
+		u64 sum = 0;
+		timer.start();
+		for (u64 i : order)
+			sum += (filled.get_component<Component<I>>(entities[i]).value + ...);
+		timer.stop();
+		sink = sum;
+	});
+
+	runner.run(label(name.c_str(), ("iterate/" + types).c_str(), pattern, size), size, [&](Timer& timer) {
+		u64 sum = 0;
+		timer.start();
+		filled.view<Component<I>...>().each([&](u64, Component<I>&... components) {
+			sum += (components.value + ...);
+		});
+		timer.stop();
+		sink = sum;
+	});
+
+	if constexpr (sizeof...(I) > 1 && std::is_same_v<Component<0>, SparseComponent<0>>) {
+		Registry grouped;
+		std::vector<u64> local;
+		populate(grouped, local);
+		auto& group = grouped.group<Component<I>...>();
+		runner.run(label(name.c_str(), ("group_iterate/" + types).c_str(), pattern, size), size, [&](Timer& timer) {
+			u64 sum = 0;
+			timer.start();
+			group.each([&](u64, Component<I>&... components) {
+				sum += (components.value + ...);
+			});
+			timer.stop();
+			sink = sum;
+		});
+	}
+
+	runner.run(label(name.c_str(), ("remove/" + types).c_str(), pattern, size), size * sizeof...(I), [&](Timer& timer) {
+		Registry registry;
+		std::vector<u64> local;
+		populate(registry, local);
+		timer.start();
+		for (u64 i : order)
+			(registry.delete_component<Component<I>>(local[i]), ...);
+		timer.stop();
+	});
+}
+
+struct Body { f32 x, y, velocity_x, velocity_y; };
+
+template<>
+struct SoaFields<Body>
+{
+	static constexpr auto members = std::make_tuple(&Body::x, &Body::y, &Body::velocity_x, &Body::velocity_y);
+};
+
+//Position integration step, packed structs against one column per field
+static void bench_integration(Runner& runner)
+{
+	constexpr f32 dt = 1.0f / 60.0f;
+	for (u64 size : REGISTRY_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		SparseSet<Body> packed;
+		SoaSet<Body> columns;
+		for (u64 i = 0; i < size; i++) {
+			packed.emplace(i, Body{ 0.0f, 0.0f, f32(i), 1.0f });
+			columns.emplace(i, Body{ 0.0f, 0.0f, f32(i), 1.0f });
+		}
+
+		runner.run(label("SparseSet<Body>", "integrate", Pattern::Sequential, size), size, [&](Timer& timer) {
+			timer.start();
+			Body* bodies = packed.data();
+			for (u32 i = 0; i < packed.size(); i++) {
+				bodies[i].x += bodies[i].velocity_x * dt;
+				bodies[i].y += bodies[i].velocity_y * dt;
+			}
+			timer.stop();
+		});
+
+		runner.run(label("SoaSet<Body>", "integrate", Pattern::Sequential, size), size, [&](Timer& timer) {
+			timer.start();
+			auto x = columns.column<0>();
+			auto y = columns.column<1>();
+			auto velocity_x = columns.column<2>();
+			auto velocity_y = columns.column<3>();
+			for (u32 i = 0; i < x.size(); i++) {
+				x[i] += velocity_x[i] * dt;
+				y[i] += velocity_y[i] * dt;
+			}
+			timer.stop();
+		});
+	}
+}
+
+template<u32... I>
+static void bench_archetype_family(Runner& runner, u64 size, Pattern pattern, std::integer_sequence<u32, I...>)
+{
+	const std::string types = std::to_string(sizeof...(I)) + "types";
+	const std::vector<u64> order = make_keys(size, pattern);
+
+	ArchetypeRegistry registry;
+	std::vector<u64> entities(size);
+	for (u64 i = 0; i < size; i++)
+		entities[i] = registry.create_entity();
+	for (u64 i : order)
+		(registry.add_component<DenseComponent<I>>(entities[i], DenseComponent<I>{ i }), ...);
+
+	runner.run(label("ArchetypeRegistry", ("get/" + types).c_str(), pattern, size), size * sizeof...(I), [&](Timer& timer) {
+		u64 sum = 0;
+		timer.start();
+		for (u64 i : order)
+			sum += (registry.get_component<DenseComponent<I>>(entities[i]).value + ...);
+		timer.stop();
+		sink = sum;
+	});
+
+	runner.run(label("ArchetypeRegistry", ("iterate/" + types).c_str(), pattern, size), size, [&](Timer& timer) {
+		u64 sum = 0;
+		timer.start();
+		registry.each<DenseComponent<I>...>([&](u64, DenseComponent<I>&... components) {
+			sum += (components.value + ...);
+		});
+		timer.stop();
+		sink = sum;
+	});
+}
+
+//Entity creation from one thread against every thread of a pool at once
+static void bench_entity_creation(Runner& runner)
+{
+	ThreadPool pool;
+	for (u64 size : REGISTRY_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		runner.run(label("Registry", "create_entity", Pattern::Sequential, size), size, [&](Timer& timer) {
+			Registry registry;
+			timer.start();
+			for (u64 i = 0; i < size; i++)
+				sink = registry.create_entity();
+			timer.stop();
+		});
+
+		runner.run(label("Registry", "create_entity_concurrent", Pattern::Sequential, size), size, [&](Timer& timer) {
+			Registry registry;
+			const u32 chunks = pool.size();
+			timer.start();
+			pool.parallel_for(chunks, [&](u32 chunk) {
+				u64 last = 0;
+				for (u64 i = size * chunk / chunks; i < size * (chunk + 1) / chunks; i++)
+					last = registry.create_entity_concurrent();
+				sink = last;
+			});
+			registry.reclaim_entities();
+			timer.stop();
+		});
+	}
+}
+
+//One frame of one shot components: every entity gets one, then they are all dropped. A frame
+//is run before the timed one so the storages, and the arena, are already grown
+template<class Component, class Drop>
+static void bench_frame_components(Runner& runner, const char* family, u64 size, Drop&& drop)
+{
+	runner.run(label(family, "add_drop", Pattern::Sequential, size), size, [&](Timer& timer) {
+		Registry registry;
+		std::vector<u64> entities(size);
+		for (u64& entity : entities)
+			entity = registry.create_entity();
+
+		for (u32 frame = 0; frame < 2; frame++) {
+			if (frame == 1)
+				timer.start();
+			for (u64 entity : entities)
+				registry.add_component<Component>(entity, Component{ entity });
+			drop(registry, entities);
+		}
+		timer.stop();
+	});
+}
+
+static void bench_transient(Runner& runner)
+{
+	for (u64 size : REGISTRY_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		bench_frame_components<DenseComponent<0>>(runner, "DenseMap", size, [](Registry& registry, const std::vector<u64>& entities) {
+			registry.delete_components<DenseComponent<0>>(entities.begin(), entities.end());
+		});
+		bench_frame_components<SparseComponent<0>>(runner, "SparseSet", size, [](Registry& registry, const std::vector<u64>&) {
+			registry.clear_components<SparseComponent<0>>();
+		});
+		bench_frame_components<TransientComponent<0>>(runner, "TransientSet", size, [](Registry& registry, const std::vector<u64>&) {
+			registry.end_frame();
+		});
+	}
+}
+
+//One stats sample of every storage, as a frame would take it, the size does not change the cost
+//but for the O(log n) tree walk
+static void bench_memory_stats(Runner& runner)
+{
+	constexpr u64 SAMPLES = 1000;
+	for (u64 size : REGISTRY_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		Registry registry;
+		for (u64 i = 0; i < size; i++) {
+			const u64 entity = registry.create_entity();
+			registry.add_component<DenseComponent<0>>(entity, DenseComponent<0>{ i });
+			registry.add_component<SparseComponent<0>>(entity, SparseComponent<0>{ i });
+			registry.add_component<TransientComponent<0>>(entity, TransientComponent<0>{ i });
+		}
+
+		runner.run(label("Registry", "storage_stats", Pattern::Sequential, size), SAMPLES, [&](Timer& timer) {
+			std::vector<StorageStats> stats;
+			timer.start();
+			for (u64 i = 0; i < SAMPLES; i++) {
+				registry.storage_stats(stats);
+				sink = stats[0].components.node_bytes;
+			}
+			timer.stop();
+		});
+	}
+}
+
+//World load, adding every component again against mapping a saved snapshot
+static void bench_snapshot(Runner& runner)
+{
+	const char* path = "ecs_bench_snapshot.bin";
+	auto populate = [](Registry& registry, u64 size) {
+		for (u64 i = 0; i < size; i++) {
+			const u64 entity = registry.create_entity();
+			registry.add_component<SparseComponent<0>>(entity, SparseComponent<0>{ i });
+			registry.add_component<SparseComponent<1>>(entity, SparseComponent<1>{ i });
+			registry.add_component<SparseComponent<2>>(entity, SparseComponent<2>{ i });
+			registry.add_component<SparseComponent<3>>(entity, SparseComponent<3>{ i });
+		}
+	};
+
+	for (u64 size : REGISTRY_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		runner.run(label("Registry<SparseSet>", "load_replay/4types", Pattern::Sequential, size), size * 4, [&](Timer& timer) {
+			timer.start();
+			Registry registry;
+			populate(registry, size);
+			timer.stop();
+			sink = registry.entity_count();
+		});
+
+		{
+			Registry saved;
+			populate(saved, size);
+			if (!saved.save_snapshot(path))
+				continue;
+		}
+
+		runner.run(label("Registry<SparseSet>", "load_snapshot/4types", Pattern::Sequential, size), size * 4, [&](Timer& timer) {
+			timer.start();
+			Registry registry;
+			registry.register_components<SparseComponent<0>, SparseComponent<1>, SparseComponent<2>, SparseComponent<3>>();
+			const bool loaded = registry.load_snapshot(path);
+			timer.stop();
+			sink = loaded ? registry.entity_count() : 0;
+		});
+
+		std::remove(path);
+	}
+}
+
+template<u32 Count>
+static void bench_registries(Runner& runner)
+{
+	for (u64 size : REGISTRY_SIZES) {
+		if (!runner.enabled(size))
+			continue;
+
+		for (Pattern pattern : PATTERNS) {
+			bench_registry_family<DenseComponent>(runner, "DenseMap", size, pattern, std::make_integer_sequence<u32, Count>{});
+			bench_registry_family<SparseComponent>(runner, "SparseSet", size, pattern, std::make_integer_sequence<u32, Count>{});
+			bench_archetype_family(runner, size, pattern, std::make_integer_sequence<u32, Count>{});
+		}
+	}
+}
+
+static bool parse_option(const char* argument, const char* name, std::string& value)
+{
+	const size_t length = std::strlen(name);
+	if (std::strncmp(argument, name, length) != 0 || argument[length] != '=')
+		return false;
+
+	value = argument + length + 1;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string value;
+		if (parse_option(argv[i], "--benchmark_filter", value))
+			options.filter = value;
+		else if (parse_option(argv[i], "--benchmark_out", value))
+			options.out = value;
+		else if (parse_option(argv[i], "--benchmark_min_time", value))
+			options.min_time = std::atof(value.c_str());
+		else if (parse_option(argv[i], "--benchmark_max_size", value))
+			options.max_size = std::strtoull(value.c_str(), nullptr, 10);
+		else {
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	Runner runner{ options };
+	std::printf("%-64s %17s %17s %10s %20s\n", "Benchmark", "Time", "CPU", "Iterations", "Throughput");
+
+	bench_bucket_allocator(runner);
+	bench_containers(runner);
+	bench_integration(runner);
+	bench_entity_creation(runner);
+	bench_transient(runner);
+	bench_memory_stats(runner);
+	bench_snapshot(runner);
+	bench_registries<1>(runner);
+	bench_registries<2>(runner);
+	bench_registries<4>(runner);
+	bench_registries<8>(runner);
+
+	if (!runner.write_json()) {
+		std::fprintf(stderr, "could not write %s\n", options.out.c_str());
+		return 1;
+	}
+
+	return 0;
+}
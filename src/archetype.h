@@ -0,0 +1,409 @@
+#pragma once
+#include <new>
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include "flat_map.h"
+#include "sparse_set.h"
+#include "entity.h"
+#include "type_id.h"
+
+//Type erased description of a component column inside an archetype
+struct ComponentInfo
+{
+	u64 hash_of_type;
+	u32 size;
+	u32 alignment;
+	//Move constructs into destination and destroys the source
+	void (*relocate)(void* destination, void* source);
+	void (*destroy)(void* memory);
+};
+
+template<class Type>
+inline const ComponentInfo* component_info()
+{
+	static const ComponentInfo info{
+		type_hash<Type>(),
+		sizeof(Type),
+		alignof(Type),
+		[](void* destination, void* source) {
+			new (destination) Type(std::move(*static_cast<Type*>(source)));
+			static_cast<Type*>(source)->~Type();
+		},
+		[](void* memory) { static_cast<Type*>(memory)->~Type(); }
+	};
+	return &info;
+}
+
+//Every entity with the same set of components lives here, rows are packed
+//in fixed size chunks, each chunk holding one array per component (SoA)
+class Archetype
+{
+public:
+	static constexpr u32 CHUNK_SIZE     = 16 * 1024;
+	static constexpr u32 CHUNK_ALIGN    = 64;
+	static constexpr u32 NOT_FOUND      = 0xFFFFFFFF;
+
+	Archetype(std::vector<const ComponentInfo*> components) : signature{ std::move(components) }, count{0}
+	{
+		u32 row_size = sizeof(u64);
+		for (const ComponentInfo* info : signature) {
+			row_size += info->size;
+			chunk_align = std::max(chunk_align, info->alignment);
+		}
+
+		chunk_bytes = CHUNK_SIZE;
+		chunk_capacity = chunk_bytes / row_size;
+		if (chunk_capacity == 0) {
+			chunk_bytes = row_size;
+			chunk_capacity = 1;
+		}
+
+		//Alignment padding between the columns may not fit, shrink until it does
+		while (!compute_offsets()) {
+			if (chunk_capacity > 1) {
+				--chunk_capacity;
+			}
+			else {
+				chunk_bytes += chunk_align;
+			}
+		}
+	}
+
+	Archetype(const Archetype&) = delete;
+	Archetype& operator=(const Archetype&) = delete;
+
+	~Archetype()
+	{
+		for (u32 row = 0; row < count; row++) {
+			for (u32 column = 0; column < signature.size(); column++)
+				signature[column]->destroy(component(row, column));
+		}
+
+		for (u8* chunk : chunks)
+			::operator delete(chunk, std::align_val_t{ chunk_align });
+	}
+
+	//Reserves a row for the entity, the components are left unconstructed
+	u32 push(u64 entity)
+	{
+		const u32 row = count++;
+		if (row / chunk_capacity >= chunks.size())
+			chunks.push_back(static_cast<u8*>(::operator new(chunk_bytes, std::align_val_t{ chunk_align })));
+
+		entities(row / chunk_capacity)[row % chunk_capacity] = entity;
+		return row;
+	}
+
+	//The components of the row need to be relocated or destroyed already,
+	//the last row fills the hole and its entity is returned to update its location
+	u64 remove(u32 row)
+	{
+		assert(row < count);
+		const u32 last = --count;
+		if (row == last)
+			return NULL_ENTITY;
+
+		for (u32 column = 0; column < signature.size(); column++)
+			signature[column]->relocate(component(row, column), component(last, column));
+
+		const u64 moved = entities(last / chunk_capacity)[last % chunk_capacity];
+		entities(row / chunk_capacity)[row % chunk_capacity] = moved;
+		return moved;
+	}
+
+	u32 column_of(u64 hash_of_type) const
+	{
+		for (u32 column = 0; column < signature.size(); column++) {
+			if (signature[column]->hash_of_type == hash_of_type)
+				return column;
+		}
+
+		return NOT_FOUND;
+	}
+
+	void* component(u32 row, u32 column)
+	{
+		return chunks[row / chunk_capacity] + offsets[column] + (row % chunk_capacity) * signature[column]->size;
+	}
+
+	u64* entities(u32 chunk)
+	{
+		return reinterpret_cast<u64*>(chunks[chunk]);
+	}
+
+	template<class Type>
+	Type* column_data(u32 chunk, u32 column)
+	{
+		return reinterpret_cast<Type*>(chunks[chunk] + offsets[column]);
+	}
+
+	u32 rows_in_chunk(u32 chunk) const
+	{
+		const u32 first = chunk * chunk_capacity;
+		return count - first < chunk_capacity ? count - first : chunk_capacity;
+	}
+
+	u32 chunk_count() const
+	{
+		return (count + chunk_capacity - 1) / chunk_capacity;
+	}
+
+	u32 size() const { return count; }
+
+public:
+	//Sorted by hash_of_type
+	const std::vector<const ComponentInfo*> signature;
+	//Cached transitions, keyed by the hash of the added/removed type
+	FlatMap<u64, Archetype*> add_edges, remove_edges;
+
+private:
+	bool compute_offsets()
+	{
+		offsets.resize(signature.size());
+		u64 offset = sizeof(u64) * chunk_capacity;
+		for (u32 column = 0; column < signature.size(); column++) {
+			const u32 alignment = signature[column]->alignment;
+			offset = (offset + alignment - 1) / alignment * alignment;
+			offsets[column] = static_cast<u32>(offset);
+			offset += static_cast<u64>(signature[column]->size) * chunk_capacity;
+		}
+
+		return offset <= chunk_bytes;
+	}
+
+private:
+	std::vector<u32> offsets;
+	std::vector<u8*> chunks;
+	u32 chunk_bytes, chunk_capacity;
+	//Columns are aligned relative to the chunk start, so it is allocated at the largest alignment
+	u32 chunk_align = CHUNK_ALIGN;
+	u32 count;
+};
+
+//Alternative to Registry storing entities by component signature instead of
+//one TypeStorage per type, multi component iteration walks chunk arrays linearly
+//while adding or removing a component moves the entity to another archetype
+class ArchetypeRegistry
+{
+	struct EntityLocation
+	{
+		Archetype* archetype;
+		u32 row;
+	};
+
+public:
+	ArchetypeRegistry()
+	{
+		empty_archetype = create_archetype({});
+	}
+
+	template <class Type, class... Args>
+	Type& add_component(u64 entity, Args&&... args)
+	{
+		static_assert(!std::is_same_v<Type, void>, "void allocation not possible");
+		assert(entities.valid(entity));
+		const ComponentInfo* info = component_info<Type>();
+
+		EntityLocation& location = locations.get_at(entity);
+		Archetype* source = location.archetype;
+		assert(source->column_of(info->hash_of_type) == Archetype::NOT_FOUND);
+
+		Archetype* destination = nullptr;
+		auto edge = source->add_edges.find(info->hash_of_type);
+		if (edge != source->add_edges.end()) {
+			destination = *edge;
+		}
+		else {
+			std::vector<const ComponentInfo*> signature = source->signature;
+			signature.push_back(info);
+			destination = find_or_create_archetype(std::move(signature));
+			source->add_edges.emplace(info->hash_of_type, destination);
+			destination->remove_edges.emplace(info->hash_of_type, source);
+		}
+
+		move_entity(entity, destination);
+		const EntityLocation& moved = locations.get_at(entity);
+		void* memory = destination->component(moved.row, destination->column_of(info->hash_of_type));
+		return *new (memory) Type{ std::forward<Args>(args)... };
+	}
+
+	template<class Type>
+	[[nodiscard]] Type& get_component(u64 entity)
+	{
+		const EntityLocation& location = locations.get_at(entity);
+		const u32 column = location.archetype->column_of(type_hash<Type>());
+		assert(column != Archetype::NOT_FOUND);
+		return *static_cast<Type*>(location.archetype->component(location.row, column));
+	}
+
+	template<class Type>
+	[[nodiscard]] bool has_component(u64 entity) const
+	{
+		const EntityLocation& location = locations.get_at(entity);
+		return location.archetype->column_of(type_hash<Type>()) != Archetype::NOT_FOUND;
+	}
+
+	template<class Type, class... Args>
+	[[nodiscard]] Type& replace_component(u64 entity, Args&&... args)
+	{
+		Type* component = &get_component<Type>(entity);
+		component->~Type();
+		return *new (component) Type{ std::forward<Args>(args)... };
+	}
+
+	template<class Type>
+	void delete_component(u64 entity)
+	{
+		const u64 hash_of_type = type_hash<Type>();
+		Archetype* source = locations.get_at(entity).archetype;
+		assert(source->column_of(hash_of_type) != Archetype::NOT_FOUND);
+
+		Archetype* destination = nullptr;
+		auto edge = source->remove_edges.find(hash_of_type);
+		if (edge != source->remove_edges.end()) {
+			destination = *edge;
+		}
+		else {
+			std::vector<const ComponentInfo*> signature;
+			for (const ComponentInfo* info : source->signature) {
+				if (info->hash_of_type != hash_of_type)
+					signature.push_back(info);
+			}
+
+			destination = find_or_create_archetype(std::move(signature));
+			source->remove_edges.emplace(hash_of_type, destination);
+			destination->add_edges.emplace(hash_of_type, source);
+		}
+
+		move_entity(entity, destination);
+	}
+
+	//func(u64 entity, Types&... components), visits every archetype containing all of Types
+	template<class... Types, class Func>
+	void each(Func&& func)
+	{
+		for (const std::unique_ptr<Archetype>& archetype : archetypes) {
+			const u32 columns[] = { archetype->column_of(type_hash<Types>())... };
+			bool matches = true;
+			for (u32 column : columns)
+				matches = matches && column != Archetype::NOT_FOUND;
+
+			if (matches)
+				each_in_archetype<Types...>(*archetype, columns, func, std::index_sequence_for<Types...>{});
+		}
+	}
+
+	u64 create_entity()
+	{
+		const u64 entity = entities.create();
+		locations.emplace(entity, EntityLocation{ empty_archetype, empty_archetype->push(entity) });
+		return entity;
+	}
+
+	void destroy_entity(u64 entity)
+	{
+		assert(entities.valid(entity));
+		const EntityLocation location = locations.get_at(entity);
+		Archetype* archetype = location.archetype;
+		for (u32 column = 0; column < archetype->signature.size(); column++)
+			archetype->signature[column]->destroy(archetype->component(location.row, column));
+
+		const u64 moved = archetype->remove(location.row);
+		if (moved != NULL_ENTITY)
+			locations.get_at(moved).row = location.row;
+
+		locations.erase(entity);
+		entities.destroy(entity);
+	}
+
+	bool valid(u64 entity) const
+	{
+		return entities.valid(entity);
+	}
+
+	u32 archetype_count() const
+	{
+		return static_cast<u32>(archetypes.size());
+	}
+
+private:
+	template<class... Types, class Func, size_t... I>
+	void each_in_archetype(Archetype& archetype, const u32* columns, Func& func, std::index_sequence<I...>)
+	{
+		for (u32 chunk = 0; chunk < archetype.chunk_count(); chunk++) {
+			const u64* entities = archetype.entities(chunk);
+			std::tuple<Types*...> arrays{ archetype.column_data<Types>(chunk, columns[I])... };
+			const u32 rows = archetype.rows_in_chunk(chunk);
+			for (u32 row = 0; row < rows; row++)
+				func(entities[row], std::get<I>(arrays)[row]...);
+		}
+	}
+
+	//Components shared by both archetypes are relocated, the ones missing in the destination destroyed
+	void move_entity(u64 entity, Archetype* destination)
+	{
+		EntityLocation& location = locations.get_at(entity);
+		Archetype* source = location.archetype;
+		const u32 row = destination->push(entity);
+
+		for (u32 column = 0; column < source->signature.size(); column++) {
+			const ComponentInfo* info = source->signature[column];
+			const u32 target = destination->column_of(info->hash_of_type);
+			if (target != Archetype::NOT_FOUND)
+				info->relocate(destination->component(row, target), source->component(location.row, column));
+			else
+				info->destroy(source->component(location.row, column));
+		}
+
+		const u64 moved = source->remove(location.row);
+		if (moved != NULL_ENTITY)
+			locations.get_at(moved).row = location.row;
+
+		location = EntityLocation{ destination, row };
+	}
+
+	Archetype* find_or_create_archetype(std::vector<const ComponentInfo*> signature)
+	{
+		std::sort(signature.begin(), signature.end(), [](const ComponentInfo* first, const ComponentInfo* second) {
+			return first->hash_of_type < second->hash_of_type;
+		});
+
+		auto iter = archetype_lookup.find(signature_hash(signature));
+		if (iter != archetype_lookup.end()) {
+			for (Archetype* archetype : *iter) {
+				if (archetype->signature == signature)
+					return archetype;
+			}
+		}
+
+		return create_archetype(std::move(signature));
+	}
+
+	//Archetypes whose signatures collide on the hash share its bucket
+	Archetype* create_archetype(std::vector<const ComponentInfo*> signature)
+	{
+		const u64 hash = signature_hash(signature);
+		archetypes.push_back(std::make_unique<Archetype>(std::move(signature)));
+		archetype_lookup[hash].push_back(archetypes.back().get());
+		return archetypes.back().get();
+	}
+
+	static u64 signature_hash(const std::vector<const ComponentInfo*>& signature)
+	{
+		u64 hash = 11447;
+		for (const ComponentInfo* info : signature)
+			hash = (hash << 5) + hash + info->hash_of_type;
+
+		return hash;
+	}
+
+private:
+	EntityPool entities;
+	SparseSet<EntityLocation> locations;
+	std::vector<std::unique_ptr<Archetype>> archetypes;
+	FlatMap<u64, std::vector<Archetype*>> archetype_lookup;
+	Archetype* empty_archetype;
+};
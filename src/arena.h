@@ -0,0 +1,84 @@
+#pragma once
+#include <new>
+#include <vector>
+#include "types.h"
+#include "memory_resource.h"
+
+//Bump allocator over a list of blocks: an allocation moves a pointer forward and nothing is
+//freed on its own. reset() rewinds to the first block and keeps every block for reuse, so a
+//workload of the same size every frame stops allocating after the first one. The blocks come
+//from resource. Not thread safe
+class MonotonicArena
+{
+public:
+	MonotonicArena() = default;
+	explicit MonotonicArena(MemoryResource& resource) : resource{&resource} {}
+	MonotonicArena(const MonotonicArena&) = delete;
+	MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+	~MonotonicArena()
+	{
+		for (const Block& block : blocks)
+			resource->deallocate(block.memory, block.size, BLOCK_ALIGN);
+	}
+
+	//alignment needs to be a power of two, at most BLOCK_ALIGN
+	void* allocate(u64 bytes, u64 alignment)
+	{
+		assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= BLOCK_ALIGN);
+		while (current < blocks.size()) {
+			const u64 start = (offset + alignment - 1) & ~(alignment - 1);
+			if (start + bytes <= blocks[current].size) {
+				offset = start + bytes;
+				used += bytes;
+				return blocks[current].memory + start;
+			}
+
+			++current;
+			offset = 0;
+		}
+
+		//Requests larger than a block get one of their own
+		const u64 size = bytes > BLOCK_SIZE ? bytes : BLOCK_SIZE;
+		blocks.push_back(Block{ static_cast<u8*>(resource->allocate(size, BLOCK_ALIGN)), size });
+		reserved += size;
+		current = static_cast<u32>(blocks.size() - 1);
+		offset = bytes;
+		used += bytes;
+		return blocks[current].memory;
+	}
+
+	template<class Type>
+	Type* allocate(u32 count = 1)
+	{
+		return static_cast<Type*>(allocate(sizeof(Type) * static_cast<u64>(count), alignof(Type)));
+	}
+
+	//Everything allocated is given back at once, the objects need to be destroyed already
+	void reset()
+	{
+		current = 0;
+		offset = 0;
+		used = 0;
+	}
+
+	//Bytes handed out since the last reset and bytes held in blocks
+	u64 bytes_used() const { return used; }
+	u64 bytes_reserved() const { return reserved; }
+
+private:
+	static constexpr u64 BLOCK_SIZE     = 1 << 16;
+	static constexpr u64 BLOCK_ALIGN    = 64;
+
+	struct Block
+	{
+		u8* memory;
+		u64 size;
+	};
+
+	MemoryResource* resource = &default_resource();
+	std::vector<Block> blocks;
+	u32 current = 0;
+	u64 offset = 0;
+	u64 used = 0, reserved = 0;
+};
@@ -0,0 +1,877 @@
+#pragma once
+#include <new>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include "types.h"
+#include "memory_resource.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BTREE_MAP_AVX2
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define BTREE_MAP_SSE42
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static inline u32 btree_popcount(u32 mask)
+{
+#if defined(_MSC_VER)
+	return static_cast<u32>(__popcnt(mask));
+#else
+	return static_cast<u32>(__builtin_popcount(mask));
+#endif
+}
+
+//Number of keys of a node lower than key, or lower or equal when inclusive. Nodes are small
+//enough for a full scan without branches to beat a binary search. 64 bit keys are compared
+//four (AVX2) or two (SSE4.2) at a time, with the sign bit flipped for the unsigned ones
+template<typename Key, bool inclusive>
+static u32 btree_count_below(const Key* keys, u32 count, Key key)
+{
+	u32 result = 0, i = 0;
+#if defined(BTREE_MAP_AVX2) || defined(BTREE_MAP_SSE42)
+	if constexpr (sizeof(Key) == 8) {
+		const s64 flip = std::is_signed_v<Key> ? 0 : static_cast<s64>(1ull << 63);
+#if defined(BTREE_MAP_AVX2)
+		const __m256i sign = _mm256_set1_epi64x(flip);
+		const __m256i target = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<s64>(key)), sign);
+		for (; i + 4 <= count; i += 4) {
+			const __m256i values = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), sign);
+			//keys[i] < key, or !(keys[i] > key) for the inclusive count
+			const __m256i below = inclusive ? _mm256_cmpgt_epi64(values, target) : _mm256_cmpgt_epi64(target, values);
+			const u32 mask = static_cast<u32>(_mm256_movemask_pd(_mm256_castsi256_pd(below)));
+			result += inclusive ? 4 - btree_popcount(mask) : btree_popcount(mask);
+		}
+#else
+		const __m128i sign = _mm_set1_epi64x(flip);
+		const __m128i target = _mm_xor_si128(_mm_set1_epi64x(static_cast<s64>(key)), sign);
+		for (; i + 2 <= count; i += 2) {
+			const __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), sign);
+			const __m128i below = inclusive ? _mm_cmpgt_epi64(values, target) : _mm_cmpgt_epi64(target, values);
+			const u32 mask = static_cast<u32>(_mm_movemask_pd(_mm_castsi128_pd(below)));
+			result += inclusive ? 2 - btree_popcount(mask) : btree_popcount(mask);
+		}
+#endif
+	}
+#endif
+	for (; i < count; i++)
+		result += inclusive ? keys[i] <= key : keys[i] < key;
+
+	return result;
+}
+
+//Leaves aim at 1KB of packed keys and values, between 8 and 64 entries
+template<typename Key, typename Type>
+constexpr u32 btree_leaf_capacity()
+{
+	constexpr u32 fit = static_cast<u32>(1024 / (sizeof(Key) + sizeof(Type)));
+	return fit < 8 ? 8 : fit > 64 ? 64 : fit;
+}
+
+//Keys and values are kept in two packed arrays, a key search only touches the first one
+template<typename Type, typename Key>
+struct BTreeLeaf
+{
+	static constexpr u32 CAPACITY = btree_leaf_capacity<Key, Type>();
+
+	Key keys[CAPACITY];
+	u32 count;
+	BTreeLeaf* prev;
+	BTreeLeaf* next;
+	alignas(Type) u8 content[sizeof(Type) * CAPACITY];
+
+	Type& value(u32 position) { return *std::launder(reinterpret_cast<Type*>(content) + position); }
+};
+
+//keys[i] separates children[i] from children[i + 1]: every key of children[i + 1] is greater
+//than or equal to it and every key of children[i] is lower
+template<typename Key>
+struct BTreeInner
+{
+	static constexpr u32 CAPACITY = 32;
+
+	Key keys[CAPACITY];
+	u32 count;
+	void* children[CAPACITY + 1];
+};
+
+template<typename Type, typename Key, bool is_reverse>
+class BTreeIterator
+{
+	using Leaf = BTreeLeaf<Type, Key>;
+public:
+	BTreeIterator(Leaf* leaf, u32 position) : leaf{leaf}, position{position} {}
+	BTreeIterator(const BTreeIterator&) = default;
+
+	BTreeIterator& operator++()
+	{
+		if (is_reverse)
+			step_back();
+		else
+			step_forward();
+
+		return *this;
+	}
+
+	BTreeIterator& operator--()
+	{
+		if (is_reverse)
+			step_forward();
+		else
+			step_back();
+
+		return *this;
+	}
+
+	bool operator==(const BTreeIterator& other) const
+	{
+		return leaf == other.leaf && position == other.position;
+	}
+
+	bool operator!=(const BTreeIterator& other) const
+	{
+		return !(*this == other);
+	}
+
+	operator bool()
+	{
+		return leaf != nullptr;
+	}
+
+	Type& operator*()
+	{
+		return leaf->value(position);
+	}
+
+	Key index() const { return leaf->keys[position]; }
+	inline Leaf* _Get_Leaf() const { return leaf; }
+	inline u32 _Get_Position() const { return position; }
+
+private:
+	void step_forward()
+	{
+		if (++position == leaf->count) {
+			leaf = leaf->next;
+			position = 0;
+		}
+	}
+
+	void step_back()
+	{
+		if (position == 0) {
+			leaf = leaf->prev;
+			position = leaf != nullptr ? leaf->count - 1 : 0;
+		}
+		else {
+			--position;
+		}
+	}
+
+private:
+	Leaf* leaf;
+	u32 position;
+};
+
+//Ordered map in a B+ tree: values only live in the leaves, which pack up to a few dozen keys
+//and values in two arrays and are linked in key order, so iterating is a walk over arrays
+//and one lookup reads a handful of nodes. Same API as DenseMap, but insertions and erasures
+//move the values around their leaf: references are only stable until the next one
+template<typename Key, typename Type>
+class BTreeMap
+{
+	static_assert(std::is_integral_v<Key>, "for b-tree maps, the Key type needs to be an integral type");
+	using Leaf =                BTreeLeaf<Type, Key>;
+	using Inner =               BTreeInner<Key>;
+public:
+	using Iterator =            BTreeIterator<Type, Key, false>;
+	using ConstIterator =       BTreeIterator<Type, Key, false>;
+	using ReverseIterator =     BTreeIterator<Type, Key, true>;
+
+public:
+	BTreeMap() = default;
+	explicit BTreeMap(MemoryResource& resource) : resource{&resource} {}
+	BTreeMap(const BTreeMap&) = delete;
+	BTreeMap& operator=(const BTreeMap&) = delete;
+
+	~BTreeMap()
+	{
+		clear();
+	}
+
+	template<class... Args>
+	Type& emplace(Key index, Args&&... args)
+	{
+		//Replace if exists
+		static_assert(std::is_constructible_v<Type, Args...>, "Type needs to be constructible with the given arguments");
+		Path path;
+		Leaf* leaf = descend(index, path);
+		const u32 position = leaf != nullptr ? btree_count_below<Key, false>(leaf->keys, leaf->count, index) : 0;
+		if (leaf != nullptr && position < leaf->count && leaf->keys[position] == index) {
+			leaf->value(position).~Type();
+			new (&leaf->value(position)) Type{ std::forward<Args>(args)... };
+			return leaf->value(position);
+		}
+
+		return insert_at(leaf, position, path, index, [&](Type* target) { new (target) Type{ std::forward<Args>(args)... }; });
+	}
+
+	Type& insert(Key index, Type& value)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		return emplace(index, std::move(value));
+	}
+
+	//Keys in [first, last) need to be sorted, unique and not in the map yet,
+	//every element is built from the same arguments
+	template<class KeyIt, class... Args>
+	void emplace_sorted(KeyIt first, KeyIt last, const Args&... args)
+	{
+		static_assert(std::is_constructible_v<Type, const Args&...>, "Type needs to be constructible with the given arguments");
+		insert_batch(first, last, [&](Type* target, u32) { new (target) Type{ args... }; });
+	}
+
+	//Same contract as emplace_sorted, first[i] gets the value moved out of values[i]
+	template<class KeyIt, class ValueIt>
+	void insert_sorted(KeyIt first, KeyIt last, ValueIt values)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		insert_batch(first, last, [&](Type* target, u32 offset) { new (target) Type(std::move(values[offset])); });
+	}
+
+	Type& get_at(Key index)
+	{
+		Iterator it = find(index);
+		assert(it != end());
+		return *it;
+	}
+
+	const Type& get_at(Key index) const
+	{
+		ConstIterator it = find(index);
+		assert(it != cend());
+		return *it;
+	}
+
+	bool contains(Key index) const
+	{
+		return find(index) != cend();
+	}
+
+	void erase(Key index)
+	{
+		Path path;
+		Leaf* leaf = descend(index, path);
+		assert(leaf != nullptr);
+		const u32 position = btree_count_below<Key, false>(leaf->keys, leaf->count, index);
+		assert(position < leaf->count && leaf->keys[position] == index);
+		erase_at(leaf, position, path);
+	}
+
+	void erase(Iterator it)
+	{
+		erase(it.index());
+	}
+
+	void erase(ReverseIterator it)
+	{
+		erase(it.index());
+	}
+
+	void erase(Iterator first, const Iterator last)
+	{
+		std::vector<Key> keys;
+		for (; first != last; ++first)
+			keys.push_back(first.index());
+
+		erase_sorted(keys.begin(), keys.end());
+	}
+
+	void erase(ReverseIterator first, const ReverseIterator last)
+	{
+		std::vector<Key> keys;
+		for (; first != last; ++first)
+			keys.push_back(first.index());
+
+		erase_sorted(keys.rbegin(), keys.rend());
+	}
+
+	//Keys need to be sorted, the ones not in the map are skipped
+	template<class KeyIt>
+	void erase_sorted(KeyIt first, KeyIt last)
+	{
+		Path path;
+		for (; first != last; ++first) {
+			Leaf* leaf = descend(*first, path);
+			if (leaf == nullptr)
+				return;
+
+			const u32 position = btree_count_below<Key, false>(leaf->keys, leaf->count, *first);
+			if (position < leaf->count && leaf->keys[position] == *first)
+				erase_at(leaf, position, path);
+		}
+	}
+
+	void clear()
+	{
+		for (Leaf* leaf = first_leaf; leaf != nullptr; leaf = leaf->next) {
+			for (u32 i = 0; i < leaf->count; i++)
+				leaf->value(i).~Type();
+		}
+
+		if (root != nullptr)
+			release(root, height);
+
+		root = nullptr;
+		first_leaf = last_leaf = nullptr;
+		height = count = 0;
+	}
+
+	u32 size() const
+	{
+		return count;
+	}
+
+	//The values live in the leaves, the height is exact
+	ContainerStats memory_usage() const
+	{
+		return ContainerStats{ count, static_cast<u64>(leaf_count) * Leaf::CAPACITY,
+			static_cast<u64>(leaf_count) * sizeof(Leaf) + static_cast<u64>(inner_count) * sizeof(Inner), 0,
+			root != nullptr ? height + 1 : 0 };
+	}
+
+	//Element at position in key order, end() past the last one. Walks the leaves, O(n / leaf size)
+	Iterator nth(u32 position)
+	{
+		Leaf* leaf = first_leaf;
+		while (leaf != nullptr && position >= leaf->count) {
+			position -= leaf->count;
+			leaf = leaf->next;
+		}
+
+		return leaf != nullptr ? Iterator{ leaf, position } : end();
+	}
+
+	//Number of keys lower than key, whether key is in the map or not. Walks the leaves
+	u32 rank(Key key) const
+	{
+		u32 result = 0;
+		for (Leaf* leaf = first_leaf; leaf != nullptr; leaf = leaf->next) {
+			const u32 below = btree_count_below<Key, false>(leaf->keys, leaf->count, key);
+			result += below;
+			if (below < leaf->count)
+				break;
+		}
+
+		return result;
+	}
+
+	//Cuts the map in at most max_chunks ranges whose sizes differ by one at most, chunk i is
+	//[boundaries[i], boundaries[i + 1]) and boundaries needs room for max_chunks + 1 entries.
+	//Only the leaf counts are read. Returns the number of chunks
+	u32 split(Iterator* boundaries, u32 max_chunks)
+	{
+		if (count == 0 || max_chunks == 0) {
+			boundaries[0] = end();
+			return 0;
+		}
+
+		const u32 chunks = max_chunks < count ? max_chunks : count;
+		Leaf* leaf = first_leaf;
+		u32 leaf_start = 0;
+		for (u32 chunk = 0; chunk < chunks; chunk++) {
+			const u32 target = static_cast<u32>(static_cast<u64>(count) * chunk / chunks);
+			while (target >= leaf_start + leaf->count) {
+				leaf_start += leaf->count;
+				leaf = leaf->next;
+			}
+
+			boundaries[chunk] = Iterator{ leaf, target - leaf_start };
+		}
+
+		boundaries[chunks] = end();
+		return chunks;
+	}
+
+	Iterator find(Key key)
+	{
+		return find_iterator(key);
+	}
+
+	ConstIterator find(Key key) const
+	{
+		return find_iterator(key);
+	}
+
+	Iterator begin()
+	{
+		return Iterator{ first_leaf, 0 };
+	}
+
+	Iterator end()
+	{
+		return Iterator{ nullptr, 0 };
+	}
+
+	Iterator cbegin() const
+	{
+		return Iterator{ first_leaf, 0 };
+	}
+
+	Iterator cend() const
+	{
+		return Iterator{ nullptr, 0 };
+	}
+
+	ReverseIterator rbegin()
+	{
+		return last_leaf != nullptr ? ReverseIterator{ last_leaf, last_leaf->count - 1 } : rend();
+	}
+
+	ReverseIterator rend()
+	{
+		return ReverseIterator{ nullptr, 0 };
+	}
+
+	ReverseIterator crbegin() const
+	{
+		return last_leaf != nullptr ? ReverseIterator{ last_leaf, last_leaf->count - 1 } : crend();
+	}
+
+	ReverseIterator crend() const
+	{
+		return ReverseIterator{ nullptr, 0 };
+	}
+
+	Type& operator[](Key index)
+	{
+		static_assert(std::is_default_constructible_v<Type>, "building objects without default constructors via the [] operator is not possible");
+		Path path;
+		Leaf* leaf = descend(index, path);
+		const u32 position = leaf != nullptr ? btree_count_below<Key, false>(leaf->keys, leaf->count, index) : 0;
+		if (leaf != nullptr && position < leaf->count && leaf->keys[position] == index)
+			return leaf->value(position);
+
+		return insert_at(leaf, position, path, index, [](Type* target) { new (target) Type{}; });
+	}
+
+	const Type& operator[](const Key index) const
+	{
+		return get_at(index);
+	}
+
+private:
+	//Inner node and child index visited at each level, root first. 64 levels are far more
+	//than a u32 count of elements can fill with half full nodes
+	struct Path
+	{
+		Inner* nodes[64];
+		u32 children[64];
+	};
+
+	static constexpr u32 LEAF_MIN       = Leaf::CAPACITY / 2;
+	static constexpr u32 INNER_MIN      = Inner::CAPACITY / 2;
+
+	Iterator find_iterator(Key key) const
+	{
+		Leaf* leaf = root != nullptr ? descend(key) : nullptr;
+		if (leaf == nullptr)
+			return Iterator{ nullptr, 0 };
+
+		const u32 position = btree_count_below<Key, false>(leaf->keys, leaf->count, key);
+		return position < leaf->count && leaf->keys[position] == key ? Iterator{ leaf, position } : Iterator{ nullptr, 0 };
+	}
+
+	Leaf* descend(Key key) const
+	{
+		void* node = root;
+		for (u32 level = 0; level < height; level++) {
+			Inner* inner = static_cast<Inner*>(node);
+			node = inner->children[btree_count_below<Key, true>(inner->keys, inner->count, key)];
+		}
+
+		return static_cast<Leaf*>(node);
+	}
+
+	Leaf* descend(Key key, Path& path) const
+	{
+		void* node = root;
+		for (u32 level = 0; level < height; level++) {
+			Inner* inner = static_cast<Inner*>(node);
+			path.nodes[level] = inner;
+			path.children[level] = btree_count_below<Key, true>(inner->keys, inner->count, key);
+			node = inner->children[path.children[level]];
+		}
+
+		return static_cast<Leaf*>(node);
+	}
+
+	Leaf* new_leaf()
+	{
+		Leaf* leaf = resource->allocate_array<Leaf>(1);
+		leaf->count = 0;
+		leaf->prev = leaf->next = nullptr;
+		++leaf_count;
+		return leaf;
+	}
+
+	Inner* new_inner()
+	{
+		++inner_count;
+		return resource->allocate_array<Inner>(1);
+	}
+
+	void free_node(Leaf* leaf)
+	{
+		--leaf_count;
+		resource->deallocate_array(leaf, 1);
+	}
+
+	void free_node(Inner* inner)
+	{
+		--inner_count;
+		resource->deallocate_array(inner, 1);
+	}
+
+	//Moves count values from source to an uninitialized target, the ranges may overlap
+	static void move_values(Leaf* target, u32 target_position, Leaf* source, u32 source_position, u32 count)
+	{
+		if (count == 0)
+			return;
+
+		std::memmove(target->keys + target_position, source->keys + source_position, sizeof(Key) * count);
+		if constexpr (std::is_trivially_copyable_v<Type>) {
+			std::memmove(&target->value(target_position), &source->value(source_position), sizeof(Type) * count);
+		}
+		else if (target != source || target_position < source_position) {
+			for (u32 i = 0; i < count; i++) {
+				new (&target->value(target_position + i)) Type(std::move(source->value(source_position + i)));
+				source->value(source_position + i).~Type();
+			}
+		}
+		else {
+			for (u32 i = count; i-- > 0;) {
+				new (&target->value(target_position + i)) Type(std::move(source->value(source_position + i)));
+				source->value(source_position + i).~Type();
+			}
+		}
+	}
+
+	//position is where index goes in leaf, nullptr for an empty map. construct builds the value in place
+	template<class Construct>
+	Type& insert_at(Leaf* leaf, u32 position, Path& path, Key index, Construct&& construct)
+	{
+		if (leaf == nullptr) {
+			leaf = new_leaf();
+			root = first_leaf = last_leaf = leaf;
+		}
+
+		Leaf* target = leaf;
+		if (leaf->count == Leaf::CAPACITY) {
+			Leaf* right = new_leaf();
+			const u32 middle = Leaf::CAPACITY / 2;
+			move_values(right, 0, leaf, middle, Leaf::CAPACITY - middle);
+			right->count = Leaf::CAPACITY - middle;
+			leaf->count = middle;
+
+			right->prev = leaf;
+			right->next = leaf->next;
+			(leaf->next != nullptr ? leaf->next->prev : last_leaf) = right;
+			leaf->next = right;
+
+			if (position > middle) {
+				target = right;
+				position -= middle;
+			}
+
+			//The new key never becomes the first one of right, right->keys[0] stays valid
+			insert_into_parent(path, height, right->keys[0], right);
+		}
+
+		move_values(target, position + 1, target, position, target->count - position);
+		target->keys[position] = index;
+		construct(&target->value(position));
+		++target->count;
+		++count;
+		return target->value(position);
+	}
+
+	//Adds right after the child of path.nodes[level - 1] the path went through
+	void insert_into_parent(Path& path, u32 level, Key separator, void* right)
+	{
+		if (level == 0) {
+			Inner* new_root = new_inner();
+			new_root->count = 1;
+			new_root->keys[0] = separator;
+			new_root->children[0] = root;
+			new_root->children[1] = right;
+			root = new_root;
+			++height;
+			return;
+		}
+
+		Inner* inner = path.nodes[level - 1];
+		const u32 child = path.children[level - 1];
+		if (inner->count < Inner::CAPACITY) {
+			insert_separator(inner, child, separator, right);
+			return;
+		}
+
+		//Full node, the keys and children are laid out with the new one and cut in the middle
+		Key keys[Inner::CAPACITY + 1];
+		void* children[Inner::CAPACITY + 2];
+		std::copy(inner->keys, inner->keys + child, keys);
+		keys[child] = separator;
+		std::copy(inner->keys + child, inner->keys + Inner::CAPACITY, keys + child + 1);
+		std::copy(inner->children, inner->children + child + 1, children);
+		children[child + 1] = right;
+		std::copy(inner->children + child + 1, inner->children + Inner::CAPACITY + 1, children + child + 2);
+
+		const u32 middle = (Inner::CAPACITY + 1) / 2;
+		Inner* sibling = new_inner();
+		inner->count = middle;
+		std::copy(keys, keys + middle, inner->keys);
+		std::copy(children, children + middle + 1, inner->children);
+		sibling->count = Inner::CAPACITY - middle;
+		std::copy(keys + middle + 1, keys + Inner::CAPACITY + 1, sibling->keys);
+		std::copy(children + middle + 1, children + Inner::CAPACITY + 2, sibling->children);
+
+		insert_into_parent(path, level - 1, keys[middle], sibling);
+	}
+
+	static void insert_separator(Inner* inner, u32 child, Key separator, void* right)
+	{
+		std::copy_backward(inner->keys + child, inner->keys + inner->count, inner->keys + inner->count + 1);
+		std::copy_backward(inner->children + child + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+		inner->keys[child] = separator;
+		inner->children[child + 1] = right;
+		++inner->count;
+	}
+
+	static void remove_separator(Inner* inner, u32 key)
+	{
+		std::copy(inner->keys + key + 1, inner->keys + inner->count, inner->keys + key);
+		std::copy(inner->children + key + 2, inner->children + inner->count + 1, inner->children + key + 1);
+		--inner->count;
+	}
+
+	//Separators are left as they are when a first key goes away, they still split the children.
+	//A leaf or inner node under half full borrows from a sibling or merges with it
+	void erase_at(Leaf* leaf, u32 position, Path& path)
+	{
+		leaf->value(position).~Type();
+		move_values(leaf, position, leaf, position + 1, leaf->count - position - 1);
+		--leaf->count;
+		--count;
+
+		if (height == 0) {
+			if (leaf->count == 0) {
+				free_node(leaf);
+				root = first_leaf = last_leaf = nullptr;
+			}
+
+			return;
+		}
+
+		if (leaf->count >= LEAF_MIN)
+			return;
+
+		Inner* parent = path.nodes[height - 1];
+		const u32 child = path.children[height - 1];
+		Leaf* left = child > 0 ? static_cast<Leaf*>(parent->children[child - 1]) : nullptr;
+		Leaf* right = child < parent->count ? static_cast<Leaf*>(parent->children[child + 1]) : nullptr;
+
+		if (left != nullptr && left->count > LEAF_MIN) {
+			move_values(leaf, 1, leaf, 0, leaf->count);
+			move_values(leaf, 0, left, left->count - 1, 1);
+			--left->count;
+			++leaf->count;
+			parent->keys[child - 1] = leaf->keys[0];
+			return;
+		}
+
+		if (right != nullptr && right->count > LEAF_MIN) {
+			move_values(leaf, leaf->count, right, 0, 1);
+			move_values(right, 0, right, 1, right->count - 1);
+			--right->count;
+			++leaf->count;
+			parent->keys[child] = right->keys[0];
+			return;
+		}
+
+		//Merge with a sibling, the right node of the pair is freed
+		const u32 separator = left != nullptr ? child - 1 : child;
+		Leaf* kept = left != nullptr ? left : leaf;
+		Leaf* removed = left != nullptr ? leaf : right;
+		move_values(kept, kept->count, removed, 0, removed->count);
+		kept->count += removed->count;
+		kept->next = removed->next;
+		(removed->next != nullptr ? removed->next->prev : last_leaf) = kept;
+		free_node(removed);
+
+		remove_separator(parent, separator);
+		rebalance(path, height - 1);
+	}
+
+	//path.nodes[level] lost a child
+	void rebalance(Path& path, u32 level)
+	{
+		Inner* node = path.nodes[level];
+		if (level == 0) {
+			//A root with a single child is dropped
+			if (node->count == 0) {
+				root = node->children[0];
+				--height;
+				free_node(node);
+			}
+
+			return;
+		}
+
+		if (node->count >= INNER_MIN)
+			return;
+
+		Inner* parent = path.nodes[level - 1];
+		const u32 child = path.children[level - 1];
+		Inner* left = child > 0 ? static_cast<Inner*>(parent->children[child - 1]) : nullptr;
+		Inner* right = child < parent->count ? static_cast<Inner*>(parent->children[child + 1]) : nullptr;
+
+		//Borrowing rotates a child through the parent separator
+		if (left != nullptr && left->count > INNER_MIN) {
+			std::copy_backward(node->keys, node->keys + node->count, node->keys + node->count + 1);
+			std::copy_backward(node->children, node->children + node->count + 1, node->children + node->count + 2);
+			node->keys[0] = parent->keys[child - 1];
+			node->children[0] = left->children[left->count];
+			parent->keys[child - 1] = left->keys[left->count - 1];
+			--left->count;
+			++node->count;
+			return;
+		}
+
+		if (right != nullptr && right->count > INNER_MIN) {
+			node->keys[node->count] = parent->keys[child];
+			node->children[node->count + 1] = right->children[0];
+			parent->keys[child] = right->keys[0];
+			std::copy(right->keys + 1, right->keys + right->count, right->keys);
+			std::copy(right->children + 1, right->children + right->count + 1, right->children);
+			--right->count;
+			++node->count;
+			return;
+		}
+
+		//Merge, the separator moves down between the two halves
+		const u32 separator = left != nullptr ? child - 1 : child;
+		Inner* kept = left != nullptr ? left : node;
+		Inner* removed = left != nullptr ? node : right;
+		kept->keys[kept->count] = parent->keys[separator];
+		std::copy(removed->keys, removed->keys + removed->count, kept->keys + kept->count + 1);
+		std::copy(removed->children, removed->children + removed->count + 1, kept->children + kept->count + 1);
+		kept->count += removed->count + 1;
+		free_node(removed);
+
+		remove_separator(parent, separator);
+		rebalance(path, level - 1);
+	}
+
+	//An empty map is built bottom up from evenly filled leaves, otherwise the keys are inserted one by one
+	template<class KeyIt, class Construct>
+	void insert_batch(KeyIt first, KeyIt last, Construct&& construct)
+	{
+		const u32 total = static_cast<u32>(last - first);
+		if (count != 0) {
+			Path path;
+			for (u32 offset = 0; offset < total; offset++) {
+				const Key key = first[offset];
+				Leaf* leaf = descend(key, path);
+				const u32 position = btree_count_below<Key, false>(leaf->keys, leaf->count, key);
+				assert(position == leaf->count || leaf->keys[position] != key);
+				insert_at(leaf, position, path, key, [&](Type* target) { construct(target, offset); });
+			}
+
+			return;
+		}
+
+		if (total == 0)
+			return;
+
+		//Every level is cut in the fewest nodes and the entries spread evenly between them
+		std::vector<void*> nodes;
+		std::vector<Key> lowest;
+		const u32 leaf_count = (total + Leaf::CAPACITY - 1) / Leaf::CAPACITY;
+		u32 offset = 0;
+		Leaf* previous = nullptr;
+		for (u32 i = 0; i < leaf_count; i++) {
+			Leaf* leaf = new_leaf();
+			leaf->count = total / leaf_count + (i < total % leaf_count);
+			for (u32 j = 0; j < leaf->count; j++, offset++) {
+				assert(offset == 0 || first[offset - 1] < first[offset]);
+				leaf->keys[j] = first[offset];
+				construct(&leaf->value(j), offset);
+			}
+
+			leaf->prev = previous;
+			(previous != nullptr ? previous->next : first_leaf) = leaf;
+			previous = leaf;
+			nodes.push_back(leaf);
+			lowest.push_back(leaf->keys[0]);
+		}
+
+		last_leaf = previous;
+		count = total;
+		height = 0;
+		while (nodes.size() > 1) {
+			const u32 child_count = static_cast<u32>(nodes.size());
+			const u32 parent_count = (child_count + Inner::CAPACITY) / (Inner::CAPACITY + 1);
+			u32 child = 0;
+			for (u32 i = 0; i < parent_count; i++) {
+				Inner* inner = new_inner();
+				const u32 children = child_count / parent_count + (i < child_count % parent_count);
+				inner->count = children - 1;
+				for (u32 j = 0; j < children; j++, child++) {
+					inner->children[j] = nodes[child];
+					if (j > 0)
+						inner->keys[j - 1] = lowest[child];
+				}
+
+				nodes[i] = inner;
+				lowest[i] = lowest[child - children];
+			}
+
+			nodes.resize(parent_count);
+			lowest.resize(parent_count);
+			++height;
+		}
+
+		root = nodes[0];
+	}
+
+	void release(void* node, u32 level)
+	{
+		if (level == 0) {
+			free_node(static_cast<Leaf*>(node));
+			return;
+		}
+
+		Inner* inner = static_cast<Inner*>(node);
+		for (u32 i = 0; i <= inner->count; i++)
+			release(inner->children[i], level - 1);
+
+		free_node(inner);
+	}
+
+private:
+	MemoryResource* resource = &default_resource();
+	void* root = nullptr;
+	Leaf* first_leaf = nullptr;
+	Leaf* last_leaf = nullptr;
+	//Number of inner levels, the root is a leaf at 0
+	u32 height = 0;
+	u32 count = 0;
+	u32 leaf_count = 0, inner_count = 0;
+};
@@ -0,0 +1,235 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#include "registry.h"
+#include "thread_local_cache.h"
+
+//Commands of one component type recorded by one thread
+struct PendingCommands
+{
+	virtual ~PendingCommands() = default;
+
+	//all holds the commands of this type from every buffer, in buffer order
+	virtual void apply_additions(Registry& registry, PendingCommands* const* all, u32 count) = 0;
+	virtual void apply_removals(Registry& registry, PendingCommands* const* all, u32 count) = 0;
+	virtual void clear() = 0;
+};
+
+template<class Type>
+struct PendingComponents final : PendingCommands
+{
+	std::vector<u64> added;
+	std::vector<Type> values;
+	std::vector<u64> removed;
+
+	//Several additions to the same entity keep the last one. Entities owning the component
+	//already get it replaced, the others receive theirs through one sorted bulk insertion
+	void apply_additions(Registry& registry, PendingCommands* const* all, u32 count) override
+	{
+		std::vector<std::pair<u64, Type*>> entries;
+		for (u32 i = 0; i < count; i++) {
+			PendingComponents& pending = static_cast<PendingComponents&>(*all[i]);
+			for (u32 j = 0; j < pending.added.size(); j++)
+				entries.emplace_back(pending.added[j], &pending.values[j]);
+		}
+
+		std::stable_sort(entries.begin(), entries.end(), [](const auto& first, const auto& second) {
+			return first.first < second.first;
+		});
+
+		std::vector<u64> entities;
+		std::vector<Type> inserted;
+		for (size_t i = 0; i < entries.size(); i++) {
+			const u64 entity = entries[i].first;
+			if ((i + 1 < entries.size() && entries[i + 1].first == entity) || !registry.valid(entity))
+				continue;
+
+			if (registry.has_component<Type>(entity)) {
+				(void)registry.replace_component<Type>(entity, std::move(*entries[i].second));
+				continue;
+			}
+
+			entities.push_back(entity);
+			inserted.push_back(std::move(*entries[i].second));
+		}
+
+		registry.insert_components<Type>(entities.begin(), entities.end(), inserted.begin());
+	}
+
+	void apply_removals(Registry& registry, PendingCommands* const* all, u32 count) override
+	{
+		std::vector<u64> entities;
+		for (u32 i = 0; i < count; i++) {
+			const PendingComponents& pending = static_cast<const PendingComponents&>(*all[i]);
+			entities.insert(entities.end(), pending.removed.begin(), pending.removed.end());
+		}
+
+		std::sort(entities.begin(), entities.end());
+		entities.erase(std::unique(entities.begin(), entities.end()), entities.end());
+		entities.erase(std::remove_if(entities.begin(), entities.end(), [&](u64 entity) {
+			return !registry.valid(entity) || !registry.has_component<Type>(entity);
+		}), entities.end());
+
+		if (!entities.empty())
+			registry.delete_components<Type>(entities.begin(), entities.end());
+	}
+
+	void clear() override
+	{
+		added.clear();
+		values.clear();
+		removed.clear();
+	}
+};
+
+class CommandQueue;
+
+//Records structural changes of one thread, obtained through CommandQueue::local.
+//Nothing touches the registry until the queue is flushed, except create_entity
+class CommandBuffer
+{
+	friend class CommandQueue;
+public:
+	explicit CommandBuffer(CommandQueue& queue) : queue{queue} {}
+
+	//The handle is valid right away, components can be recorded for it
+	u64 create_entity();
+
+	void destroy_entity(u64 entity)
+	{
+		destroyed.push_back(entity);
+	}
+
+	template<class Type, class... Args>
+	void add_component(u64 entity, Args&&... args)
+	{
+		static_assert(!std::is_same_v<Type, void>, "void allocation not possible");
+		PendingComponents<Type>& commands = pending_of<Type>();
+		commands.added.push_back(entity);
+		commands.values.push_back(Type{ std::forward<Args>(args)... });
+	}
+
+	template<class Type>
+	void delete_component(u64 entity)
+	{
+		pending_of<Type>().removed.push_back(entity);
+	}
+
+private:
+	template<class Type>
+	PendingComponents<Type>& pending_of()
+	{
+		const u32 index = type_index<Type>();
+		if (index >= pending.size())
+			pending.resize(index + 1);
+
+		if (pending[index] == nullptr)
+			pending[index] = std::make_unique<PendingComponents<Type>>();
+
+		return static_cast<PendingComponents<Type>&>(*pending[index]);
+	}
+
+private:
+	CommandQueue& queue;
+	//Indexed by type_index
+	std::vector<std::unique_ptr<PendingCommands>> pending;
+	std::vector<u64> destroyed;
+};
+
+//Lets systems request structural changes while the storages are being iterated,
+//possibly from several threads. Every thread records into its own CommandBuffer
+//without locking, flush applies everything at a sync point in one sorted pass:
+//first the additions, then the removals, then the destructions, each grouped by
+//component type so the storages take them through their bulk paths
+class CommandQueue
+{
+public:
+	explicit CommandQueue(Registry& registry) : registry{registry} {}
+	CommandQueue(const CommandQueue&) = delete;
+	CommandQueue& operator=(const CommandQueue&) = delete;
+
+	//Buffer of the calling thread, only the first call of each thread locks
+	CommandBuffer& local()
+	{
+		return ThreadLocalCache<CommandBuffer>::get(key, [this]() -> CommandBuffer& {
+			std::lock_guard<std::mutex> lock{ mutex };
+			buffers.push_back(std::make_unique<CommandBuffer>(*this));
+			return *buffers.back();
+		});
+	}
+
+	//Needs to run while no thread records, e.g. between two Scheduler frames
+	void flush()
+	{
+		registry.reclaim_entities();
+		apply_components(false);
+		apply_components(true);
+
+		std::vector<u64> destroyed;
+		for (const std::unique_ptr<CommandBuffer>& buffer : buffers)
+			destroyed.insert(destroyed.end(), buffer->destroyed.begin(), buffer->destroyed.end());
+
+		std::sort(destroyed.begin(), destroyed.end());
+		destroyed.erase(std::unique(destroyed.begin(), destroyed.end()), destroyed.end());
+		destroyed.erase(std::remove_if(destroyed.begin(), destroyed.end(), [&](u64 entity) {
+			return !registry.valid(entity);
+		}), destroyed.end());
+
+		registry.destroy_entities(destroyed.begin(), destroyed.end());
+
+		for (const std::unique_ptr<CommandBuffer>& buffer : buffers) {
+			for (const std::unique_ptr<PendingCommands>& pending : buffer->pending) {
+				if (pending != nullptr)
+					pending->clear();
+			}
+
+			buffer->destroyed.clear();
+		}
+	}
+
+private:
+	friend class CommandBuffer;
+
+	void apply_components(bool removals)
+	{
+		u32 type_count = 0;
+		for (const std::unique_ptr<CommandBuffer>& buffer : buffers)
+			type_count = std::max(type_count, static_cast<u32>(buffer->pending.size()));
+
+		std::vector<PendingCommands*> same_type;
+		for (u32 index = 0; index < type_count; index++) {
+			same_type.clear();
+			for (const std::unique_ptr<CommandBuffer>& buffer : buffers) {
+				if (index < buffer->pending.size() && buffer->pending[index] != nullptr)
+					same_type.push_back(buffer->pending[index].get());
+			}
+
+			if (same_type.empty())
+				continue;
+
+			if (removals)
+				same_type[0]->apply_removals(registry, same_type.data(), static_cast<u32>(same_type.size()));
+			else
+				same_type[0]->apply_additions(registry, same_type.data(), static_cast<u32>(same_type.size()));
+		}
+	}
+
+	u64 create_entity()
+	{
+		return registry.create_entity_concurrent();
+	}
+
+private:
+	Registry& registry;
+	std::mutex mutex;
+	std::vector<std::unique_ptr<CommandBuffer>> buffers;
+	ThreadLocalCache<CommandBuffer>::Key key;
+};
+
+inline u64 CommandBuffer::create_entity()
+{
+	return queue.create_entity();
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "types.h"
+
+//Registry ticks at which a component was added and last accessed mutably
+struct ComponentTicks
+{
+	u32 added;
+	u32 changed;
+};
@@ -1,11 +1,10 @@
 #pragma once
 #include "red_black_tree.h"
 
-template<typename Type, typename Index, bool is_reverse>
+template<typename Type, typename Index, bool is_reverse, template<class, class> class Node = TreeNode>
 class MapIterator
 {
-	using NodeType = TreeNode<Type, Index>;
-	using TreeType = RedBlackTree<Type, Index>;
+	using NodeType = Node<Type, Index>;
 public:
 	MapIterator(NodeType* start) : node{start} {}
 	MapIterator(const MapIterator&) = default;
@@ -34,12 +33,12 @@ public:
 		return *this;
 	}
 
-	bool operator==(const MapIterator& other)
+	bool operator==(const MapIterator& other) const
 	{
 		return node == other.node;
 	}
 
-	bool operator!=(const MapIterator& other)
+	bool operator!=(const MapIterator& other) const
 	{
 		return node != other.node;
 	}
@@ -51,30 +50,34 @@ public:
 
 	Type& operator*()
 	{
-		return *node->content;
+		return node->value();
 	}
 
+	Index index() const { return node->index; }
 	inline NodeType* _Get_Node() const { return node; }
 
 private:
 	NodeType* node;
 };
 
-template <typename Key, typename Type>
+//NodeLayout is forwarded to the tree, InlineTreeNode avoids the separate content allocation
+//and the threaded layouts add O(1) iterator steps, nth, rank and an even split
+template <typename Key, typename Type, template<class, class> class NodeLayout = TreeNode>
 class DenseMap
 {
 public:
 	static_assert(std::is_integral_v<Key>, "for dense maps, the Key type needs to be an integral type, dense_map is not responsible for hash calculations");
 
-	using Tree =                RedBlackTree<Type>;
-	using Node =                TreeNode<Type, Key>;
-	using Iterator =            MapIterator<Type, Key, false>;
-	using ConstIterator =       MapIterator<Type, Key, false>;
-	using ReverseIterator =     MapIterator<Type, Key, true>;
+	using Tree =                RedBlackTree<Type, Key, NodeLayout>;
+	using Node =                NodeLayout<Type, Key>;
+	using Iterator =            MapIterator<Type, Key, false, NodeLayout>;
+	using ConstIterator =       MapIterator<Type, Key, false, NodeLayout>;
+	using ReverseIterator =     MapIterator<Type, Key, true, NodeLayout>;
 
 public:
 	DenseMap() = default;
-	
+	explicit DenseMap(MemoryResource& resource) : map_tree{ resource } {}
+
 	template<class... Args>
 	Type& emplace(Key index, Args&&... args)
 	{
@@ -91,11 +94,40 @@ public:
 		return map_tree.emplace_node(index, std::move(value));
 	}
 	
+	//Keys in [first, last) need to be sorted, unique and not in the map yet,
+	//every element is built from the same arguments
+	template<class KeyIt, class... Args>
+	void emplace_sorted(KeyIt first, KeyIt last, const Args&... args)
+	{
+		static_assert(std::is_constructible_v<Type, const Args&...>, "Type needs to be constructible with the given arguments");
+		map_tree.emplace_sorted(first, last, [&](u32) { return Type{ args... }; });
+	}
+
+	//Same contract as emplace_sorted, first[i] gets the value moved out of values[i]
+	template<class KeyIt, class ValueIt>
+	void insert_sorted(KeyIt first, KeyIt last, ValueIt values)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		map_tree.emplace_sorted(first, last, [&](u32 offset) { return std::move(values[offset]); });
+	}
+
 	Type& get_at(Key index)
 	{
 		Node* node = map_tree.find_node(index);
-		assert(node != nullptr && node->content != nullptr);
-		return *node->content;
+		assert(node != nullptr);
+		return node->value();
+	}
+
+	const Type& get_at(Key index) const
+	{
+		Node* node = map_tree.find_node(index);
+		assert(node != nullptr);
+		return node->value();
+	}
+
+	bool contains(Key index) const
+	{
+		return map_tree.find_node(index) != nullptr;
 	}
 
 	void erase(Key index) 
@@ -116,17 +148,88 @@ public:
 	void erase(Iterator first, const Iterator last)
 	{
 		check_range_valid(first, last);
-		for (; first != last; ++first) {
-			erase(first);
-		}
+		map_tree.erase_range(first._Get_Node(), last._Get_Node());
 	}
 
 	void erase(ReverseIterator first, const ReverseIterator last)
 	{
 		check_range_valid(first, last);
-		for (; first != last; ++first) {
-			erase(first);
+		if (first._Get_Node() == last._Get_Node())
+			return;
+
+		//Same elements as the forward range (last, first], rend() stands before the first node
+		Node* forward_first = last._Get_Node() != nullptr ? last._Get_Node()->find_next() : map_tree.find_first();
+		Node* forward_last = first._Get_Node() != nullptr ? first._Get_Node()->find_next() : map_tree.find_first();
+		map_tree.erase_range(forward_first, forward_last);
+	}
+
+	//Keys need to be sorted, the ones not in the map are skipped
+	template<class KeyIt>
+	void erase_sorted(KeyIt first, KeyIt last)
+	{
+		map_tree.erase_sorted(first, last);
+	}
+
+	void clear()
+	{
+		map_tree.clear();
+	}
+
+	u32 size() const
+	{
+		return map_tree.size();
+	}
+
+	ContainerStats memory_usage() const
+	{
+		return map_tree.memory_usage();
+	}
+
+	//Element at position in key order, end() past the last one. Threaded layouts only
+	Iterator nth(u32 position)
+	{
+		return Iterator{ map_tree.nth_node(position) };
+	}
+
+	//Number of keys lower than key, whether key is in the map or not. Threaded layouts only
+	u32 rank(Key key) const
+	{
+		return map_tree.rank(key);
+	}
+
+	//Cuts the map in at most max_chunks ranges, chunk i is [boundaries[i], boundaries[i + 1])
+	//and boundaries needs room for max_chunks + 1 entries. Threaded layouts get chunks whose
+	//sizes differ by one at most, the others cut along the top levels of the tree. The same
+	//tree shape always gives the same cuts. Returns the number of chunks
+	u32 split(Iterator* boundaries, u32 max_chunks)
+	{
+		if (size() == 0 || max_chunks == 0) {
+			boundaries[0] = end();
+			return 0;
 		}
+
+		if constexpr (Node::THREADED) {
+			const u32 chunks = max_chunks < size() ? max_chunks : size();
+			for (u32 chunk = 0; chunk < chunks; chunk++)
+				boundaries[chunk] = nth(static_cast<u32>(static_cast<u64>(size()) * chunk / chunks));
+
+			boundaries[chunks] = end();
+			return chunks;
+		}
+
+		u32 depth = 0;
+		while ((2u << depth) <= max_chunks)
+			++depth;
+
+		u32 chunks = 0;
+		boundaries[0] = begin();
+		map_tree.visit_top_levels(depth, [&](Node* node) {
+			if (node != boundaries[0]._Get_Node())
+				boundaries[++chunks] = Iterator{ node };
+		});
+
+		boundaries[++chunks] = end();
+		return chunks;
 	}
 
 	Iterator find(Key key)
@@ -134,6 +237,11 @@ public:
 		return Iterator{ map_tree.find_node(key) };
 	}
 
+	ConstIterator find(Key key) const
+	{
+		return ConstIterator{ map_tree.find_node(key) };
+	}
+
 	Iterator begin()
 	{
 		return Iterator{ map_tree.find_first() };
@@ -183,41 +291,33 @@ public:
 			return map_tree.emplace_node(index);
 		}
 
-		return *node->content;
+		return node->value();
 	}
 
 	const Type& operator[](const Key index) const
 	{
 		static_assert(std::is_default_constructible_v<Type>, "building objects without default constructors via the [] operator is not possible");
 		Node* node = map_tree.find_node(index);
-		assert(node != nullptr && node->content != nullptr);
-		return *node->content;
+		assert(node != nullptr);
+		return node->value();
 	}
 
 
 private:
+	//The tree checks that second is reachable while walking the range
 	void check_range_valid(const Iterator first, const Iterator second)
 	{
 		Node* first_node = first._Get_Node();
 		Node* second_node = second._Get_Node();
-		assert(first_node->index < second_node->index);
-
-		while (first_node && first_node != second_node)
-			first_node = first_node->find_next();
-
-		assert(first_node != nullptr);
+		assert(second_node == nullptr || first_node == second_node || first_node->index < second_node->index);
 	}
 
 	void check_range_valid(const ReverseIterator first, const ReverseIterator second)
 	{
 		Node* first_node = first._Get_Node();
 		Node* second_node = second._Get_Node();
-		assert(first_node->index > second_node->index);
-
-		while (second_node && second_node != first_node)
-			second_node = second_node->find_next();
-
-		assert(second_node != nullptr);
+		assert(first_node != nullptr || second_node == nullptr);
+		assert(second_node == nullptr || first_node == second_node || first_node->index > second_node->index);
 	}
 
 	void delete_if_exists(Key index)
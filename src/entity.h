@@ -0,0 +1,311 @@
+#pragma once
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include "types.h"
+#include "memory_resource.h"
+#include "thread_local_cache.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//An entity handle packs the generation of its slot in the upper 32 bits and
+//the slot index in the lower 32, a destroyed slot comes back with a new generation
+constexpr u64 ENTITY_INDEX_MASK     = 0xFFFFFFFF;
+constexpr u64 NULL_ENTITY           = 0xFFFFFFFFFFFFFFFF;
+
+constexpr u32 entity_index(u64 entity)
+{
+	return static_cast<u32>(entity & ENTITY_INDEX_MASK);
+}
+
+constexpr u32 entity_generation(u64 entity)
+{
+	return static_cast<u32>(entity >> 32);
+}
+
+constexpr u64 make_entity(u32 index, u32 generation)
+{
+	return (static_cast<u64>(generation) << 32) | index;
+}
+
+//Hands out entity handles, the slots of destroyed entities are reused before new ones.
+//The slots live in segments of growing size that never move, so create_concurrent can
+//add slots from several threads while the others keep reading the existing ones. The
+//segments come from resource, which needs to be thread safe for create_concurrent
+class EntityPool
+{
+public:
+	static constexpr u32 NO_SLOT        = 0xFFFFFFFF;
+	//Fresh slots a thread reserves at once in create_concurrent
+	static constexpr u32 BLOCK_SIZE     = 64;
+
+	EntityPool() : EntityPool(default_resource()) {}
+	explicit EntityPool(MemoryResource& resource) : resource{resource} {}
+	EntityPool(const EntityPool&) = delete;
+	EntityPool& operator=(const EntityPool&) = delete;
+
+	~EntityPool()
+	{
+		release();
+	}
+
+	u64 create()
+	{
+		if (free_head != NO_SLOT) {
+			//The free slot already carries the bumped generation, its index field links the next free slot
+			const u32 index = free_head;
+			u64& slot = at(index);
+			free_head = entity_index(slot);
+			slot = make_entity(index, entity_generation(slot));
+			++alive;
+			return slot;
+		}
+
+		const u32 index = reserve(1);
+		++alive;
+		return at(index) = make_entity(index, 0);
+	}
+
+	//Thread safe against itself and valid. Every thread takes BLOCK_SIZE fresh slots at a
+	//time with a single atomic add and counts its handles on a cache line of its own,
+	//destroyed slots are only reused by create. The unused rest of the blocks goes back
+	//to the free list in reclaim
+	u64 create_concurrent()
+	{
+		Block& block = local_block();
+		if (block.next == block.end) {
+			block.next = reserve(BLOCK_SIZE);
+			block.end = block.next + BLOCK_SIZE;
+			block.reserved.emplace_back(block.next, block.end);
+		}
+
+		const u32 index = block.next++;
+		block.created.store(block.created.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return at(index) = make_entity(index, 0);
+	}
+
+	//Puts the slots left in the thread blocks on the free list, no thread may create entities
+	//meanwhile. on_reserved(first, last) is called for every block reserved since the last call
+	template<class Func>
+	void reclaim(Func&& on_reserved)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		for (const std::unique_ptr<Block>& block : blocks) {
+			for (const std::pair<u32, u32>& range : block->reserved)
+				on_reserved(range.first, range.second);
+
+			//Pushed from the back so the lowest index gets reused first
+			for (u32 index = block->end; index-- > block->next;) {
+				at(index) = make_entity(free_head, 0);
+				free_head = index;
+			}
+
+			alive += block->created.exchange(0, std::memory_order_relaxed);
+			block->reserved.clear();
+			block->next = block->end = 0;
+		}
+	}
+
+	void destroy(u64 entity)
+	{
+		assert(valid(entity));
+		const u32 index = entity_index(entity);
+		at(index) = make_entity(free_head, entity_generation(entity) + 1);
+		free_head = index;
+		--alive;
+	}
+
+	//False for handles whose slot has been destroyed, even when it got reused since
+	bool valid(u64 entity) const
+	{
+		const u32 index = entity_index(entity);
+		if (index >= count.load(std::memory_order_acquire))
+			return false;
+
+		const u32 segment = segment_of(index);
+		const u64* slots = segments[segment].load(std::memory_order_acquire);
+		return slots != nullptr && slots[offset_in(index, segment)] == entity;
+	}
+
+	//Replaces the content of the pool with a table written by for_each_segment, the free
+	//list links are stored in the slots so free_slot is all it needs besides them
+	void restore(const u64* table, u32 table_count, u32 table_free_head, u32 table_alive)
+	{
+		assert(table_free_head == NO_SLOT || table_free_head < table_count);
+		release();
+		count.store(0, std::memory_order_relaxed);
+		if (table_count != 0)
+			reserve(table_count);
+
+		for (u32 copied = 0; copied < table_count;) {
+			const u32 segment = segment_of(copied);
+			const u32 amount = std::min(segment_size(segment), table_count - copied);
+			std::memcpy(segments[segment].load(std::memory_order_relaxed), table + copied, sizeof(u64) * amount);
+			copied += amount;
+		}
+
+		free_head = table_free_head;
+		alive = table_alive;
+	}
+
+	//Used to apply a delta: the table grows to table_count slots, the ones past
+	//the previous count have to be filled by restore_slot
+	void restore_state(u32 table_count, u32 table_free_head, u32 table_alive)
+	{
+		const u32 previous = count.load(std::memory_order_relaxed);
+		assert(table_count >= previous && (table_free_head == NO_SLOT || table_free_head < table_count));
+		if (table_count != previous)
+			reserve(table_count - previous);
+
+		free_head = table_free_head;
+		alive = table_alive;
+	}
+
+	void restore_slot(u32 index, u64 slot)
+	{
+		assert(index < slot_count());
+		at(index) = slot;
+	}
+
+	//func(const u64* slots, u32 count) for every segment in index order, used for serialization
+	template<class Func>
+	void for_each_segment(Func&& func) const
+	{
+		const u32 total = slot_count();
+		for (u32 first = 0; first < total;) {
+			const u32 segment = segment_of(first);
+			const u32 amount = std::min(segment_size(segment), total - first);
+			func(segments[segment].load(std::memory_order_relaxed), amount);
+			first += amount;
+		}
+	}
+
+	//Handles of create_concurrent are counted once the thread creating them is done
+	u32 size() const
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		u32 result = alive;
+		for (const std::unique_ptr<Block>& block : blocks)
+			result += block->created.load(std::memory_order_relaxed);
+
+		return result;
+	}
+
+	//Live handles against the slots of the allocated segments, the free ones included
+	ContainerStats memory_usage() const
+	{
+		u64 capacity = 0;
+		for (u32 segment = 0; segment < MAX_SEGMENTS; segment++) {
+			if (segments[segment].load(std::memory_order_acquire) != nullptr)
+				capacity += segment_size(segment);
+		}
+
+		return ContainerStats{ size(), capacity, capacity * sizeof(u64), 0, 0 };
+	}
+
+	u64 slot(u32 index) const { return at(index); }
+	u32 slot_count() const { return count.load(std::memory_order_acquire); }
+	u32 free_slot() const { return free_head; }
+
+private:
+	//Thread local state of create_concurrent
+	struct alignas(64) Block
+	{
+		u32 next = 0, end = 0;
+		std::atomic<u32> created{ 0 };
+		std::vector<std::pair<u32, u32>> reserved;
+	};
+
+	//Segment i holds FIRST_SEGMENT << i slots, the first one starting at index 0
+	static u32 segment_of(u32 index)
+	{
+		const u32 biased = index / FIRST_SEGMENT + 1;
+#if defined(_MSC_VER)
+		unsigned long result;
+		_BitScanReverse(&result, biased);
+		return result;
+#else
+		return 31 - __builtin_clz(biased);
+#endif
+	}
+
+	static u32 segment_size(u32 segment)
+	{
+		return FIRST_SEGMENT << segment;
+	}
+
+	static u32 offset_in(u32 index, u32 segment)
+	{
+		return index - FIRST_SEGMENT * ((1u << segment) - 1);
+	}
+
+	u64& at(u32 index) const
+	{
+		const u32 segment = segment_of(index);
+		return segments[segment].load(std::memory_order_relaxed)[offset_in(index, segment)];
+	}
+
+	//Claims amount fresh slots and makes sure their segments exist
+	u32 reserve(u32 amount)
+	{
+		const u32 first = count.fetch_add(amount, std::memory_order_acq_rel);
+		assert(amount <= NO_SLOT - first);
+		for (u32 segment = segment_of(first); segment <= segment_of(first + amount - 1); segment++) {
+			if (segments[segment].load(std::memory_order_acquire) != nullptr)
+				continue;
+
+			//Unused slots hold an index no handle can match
+			u64* created = resource.allocate_array<u64>(segment_size(segment));
+			std::fill(created, created + segment_size(segment), NULL_ENTITY);
+			u64* expected = nullptr;
+			if (!segments[segment].compare_exchange_strong(expected, created, std::memory_order_acq_rel))
+				resource.deallocate_array(created, segment_size(segment));
+		}
+
+		return first;
+	}
+
+	//Only the first call of each thread locks
+	Block& local_block()
+	{
+		return ThreadLocalCache<Block>::get(key, [this]() -> Block& {
+			std::lock_guard<std::mutex> lock{ mutex };
+			blocks.push_back(std::make_unique<Block>());
+			return *blocks.back();
+		});
+	}
+
+	void release()
+	{
+		for (u32 segment = 0; segment < MAX_SEGMENTS; segment++)
+			resource.deallocate_array(segments[segment].exchange(nullptr, std::memory_order_relaxed), segment_size(segment));
+
+		for (const std::unique_ptr<Block>& block : blocks) {
+			block->reserved.clear();
+			block->next = block->end = 0;
+			block->created.store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	static constexpr u32 FIRST_SEGMENT  = 1024;
+	//Enough segments for every u32 index
+	static constexpr u32 MAX_SEGMENTS   = 23;
+
+	MemoryResource& resource;
+	std::atomic<u64*> segments[MAX_SEGMENTS]{};
+	std::atomic<u32> count{ 0 };
+	u32 alive = 0;
+	u32 free_head = NO_SLOT;
+
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<Block>> blocks;
+	ThreadLocalCache<Block>::Key key;
+};
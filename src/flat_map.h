@@ -0,0 +1,548 @@
+#pragma once
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <cstring>
+#include "types.h"
+#include "memory_resource.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLAT_MAP_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//Control byte of every slot, a full slot stores the low 7 bits of its key hash
+enum class SlotState : s8
+{
+	Empty = -128,
+	Deleted = -2
+};
+
+//Sixteen control bytes matched at once, one bit per slot in the returned masks
+class ControlGroup
+{
+public:
+	static constexpr u32 SIZE = 16;
+
+	explicit ControlGroup(const s8* control)
+	{
+#if defined(FLAT_MAP_SSE2)
+		bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(control));
+#else
+		std::memcpy(bytes, control, SIZE);
+#endif
+	}
+
+	u32 match(s8 hash) const
+	{
+#if defined(FLAT_MAP_SSE2)
+		return static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(hash))));
+#else
+		u32 mask = 0;
+		for (u32 i = 0; i < SIZE; i++)
+			mask |= static_cast<u32>(bytes[i] == hash) << i;
+
+		return mask;
+#endif
+	}
+
+	u32 match_empty() const
+	{
+		return match(static_cast<s8>(SlotState::Empty));
+	}
+
+	//Empty and Deleted are the only negative bytes
+	u32 match_empty_or_deleted() const
+	{
+#if defined(FLAT_MAP_SSE2)
+		return static_cast<u32>(_mm_movemask_epi8(bytes));
+#else
+		u32 mask = 0;
+		for (u32 i = 0; i < SIZE; i++)
+			mask |= static_cast<u32>(bytes[i] < 0) << i;
+
+		return mask;
+#endif
+	}
+
+	static u32 lowest_bit(u32 mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<u32>(index);
+#else
+		return static_cast<u32>(__builtin_ctz(mask));
+#endif
+	}
+
+private:
+#if defined(FLAT_MAP_SSE2)
+	__m128i bytes;
+#else
+	s8 bytes[SIZE];
+#endif
+};
+
+template<typename Type, typename Key>
+struct FlatSlot
+{
+	Key key;
+	alignas(Type) u8 content[sizeof(Type)];
+
+	Type& value() { return *std::launder(reinterpret_cast<Type*>(content)); }
+};
+
+template<typename Type, typename Key>
+class FlatIterator
+{
+	using Slot = FlatSlot<Type, Key>;
+public:
+	FlatIterator(const s8* control, Slot* slots, u32 position, u32 capacity)
+		: control{control}, slots{slots}, position{position}, capacity{capacity} {}
+	FlatIterator(const FlatIterator&) = default;
+
+	FlatIterator& operator++()
+	{
+		do {
+			++position;
+		} while (position < capacity && control[position] < 0);
+
+		return *this;
+	}
+
+	FlatIterator& operator--()
+	{
+		do {
+			--position;
+		} while (control[position] < 0);
+
+		return *this;
+	}
+
+	bool operator==(const FlatIterator& other) const
+	{
+		return position == other.position;
+	}
+
+	bool operator!=(const FlatIterator& other) const
+	{
+		return position != other.position;
+	}
+
+	Type& operator*()
+	{
+		return slots[position].value();
+	}
+
+	Key index() const { return slots[position].key; }
+	inline u32 _Get_Position() const { return position; }
+
+private:
+	const s8* control;
+	Slot* slots;
+	u32 position, capacity;
+};
+
+//Open addressing hash map in the swiss table layout: one control byte per slot, probed
+//sixteen at a time, and the key stored next to its value, so a lookup usually reads one
+//line of control bytes and one slot. Iteration follows the slots and is unordered.
+//Growing moves the values, references are only stable until the next insertion
+template<typename Key, typename Type>
+class FlatMap
+{
+	static_assert(std::is_integral_v<Key>, "for flat maps, the Key type needs to be an integral type");
+	using Slot =                FlatSlot<Type, Key>;
+public:
+	using Iterator =            FlatIterator<Type, Key>;
+	using ConstIterator =       FlatIterator<Type, Key>;
+
+public:
+	FlatMap() = default;
+	explicit FlatMap(MemoryResource& resource) : resource{&resource} {}
+	FlatMap(const FlatMap&) = delete;
+	FlatMap& operator=(const FlatMap&) = delete;
+
+	~FlatMap()
+	{
+		release();
+	}
+
+	template<class... Args>
+	Type& emplace(Key index, Args&&... args)
+	{
+		//Replace if exists
+		static_assert(std::is_constructible_v<Type, Args...>, "Type needs to be constructible with the given arguments");
+		const u64 hash = hash_key(index);
+		u32 position = find_position(index, hash);
+		if (position != NULL_POSITION) {
+			slots[position].value().~Type();
+		}
+		else {
+			position = prepare_insert(hash);
+			slots[position].key = index;
+		}
+
+		new (slots[position].content) Type{ std::forward<Args>(args)... };
+		return slots[position].value();
+	}
+
+	Type& insert(Key index, Type& value)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		return emplace(index, std::move(value));
+	}
+
+	//Same contract as DenseMap::emplace_sorted, the table grows once for the whole batch
+	template<class KeyIt, class... Args>
+	void emplace_sorted(KeyIt first, KeyIt last, const Args&... args)
+	{
+		static_assert(std::is_constructible_v<Type, const Args&...>, "Type needs to be constructible with the given arguments");
+		reserve(count + static_cast<u32>(last - first));
+		for (; first != last; ++first) {
+			const u64 hash = hash_key(*first);
+			assert(find_position(*first, hash) == NULL_POSITION);
+			const u32 position = prepare_insert(hash);
+			slots[position].key = *first;
+			new (slots[position].content) Type{ args... };
+		}
+	}
+
+	//Same contract as DenseMap::insert_sorted
+	template<class KeyIt, class ValueIt>
+	void insert_sorted(KeyIt first, KeyIt last, ValueIt values)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		reserve(count + static_cast<u32>(last - first));
+		for (; first != last; ++first, ++values) {
+			const u64 hash = hash_key(*first);
+			assert(find_position(*first, hash) == NULL_POSITION);
+			const u32 position = prepare_insert(hash);
+			slots[position].key = *first;
+			new (slots[position].content) Type(std::move(*values));
+		}
+	}
+
+	//Makes room for element_count elements without growing again
+	void reserve(u32 element_count)
+	{
+		u32 new_capacity = capacity == 0 ? MIN_CAPACITY : capacity;
+		while (max_load(new_capacity) < element_count)
+			new_capacity *= 2;
+
+		if (new_capacity > capacity)
+			rehash(new_capacity);
+	}
+
+	Type& get_at(Key index)
+	{
+		const u32 position = find_position(index, hash_key(index));
+		assert(position != NULL_POSITION);
+		return slots[position].value();
+	}
+
+	const Type& get_at(Key index) const
+	{
+		const u32 position = find_position(index, hash_key(index));
+		assert(position != NULL_POSITION);
+		return slots[position].value();
+	}
+
+	bool contains(Key index) const
+	{
+		return find_position(index, hash_key(index)) != NULL_POSITION;
+	}
+
+	void erase(Key index)
+	{
+		const u32 position = find_position(index, hash_key(index));
+		assert(position != NULL_POSITION);
+		erase_at(position);
+	}
+
+	void erase(Iterator it)
+	{
+		erase_at(it._Get_Position());
+	}
+
+	//Keys not in the map are skipped
+	template<class KeyIt>
+	void erase_sorted(KeyIt first, KeyIt last)
+	{
+		for (; first != last; ++first) {
+			const u32 position = find_position(*first, hash_key(*first));
+			if (position != NULL_POSITION)
+				erase_at(position);
+		}
+	}
+
+	//Keeps the table allocated
+	void clear()
+	{
+		for (u32 i = 0; i < capacity; i++) {
+			if (control[i] >= 0)
+				slots[i].value().~Type();
+		}
+
+		if (capacity != 0)
+			std::memset(control, static_cast<u8>(SlotState::Empty), capacity);
+
+		count = 0;
+		growth_left = max_load(capacity);
+	}
+
+	u32 size() const
+	{
+		return count;
+	}
+
+	//The values live in the slots next to their keys
+	ContainerStats memory_usage() const
+	{
+		return ContainerStats{ count, capacity, static_cast<u64>(capacity) * (sizeof(s8) + sizeof(Slot)), 0, 0 };
+	}
+
+	//Cuts the slots in at most max_chunks ranges of the same width, moved forward to the
+	//next element, chunk i is [boundaries[i], boundaries[i + 1]) and boundaries needs room
+	//for max_chunks + 1 entries. Empty ranges are dropped, returns the number of chunks
+	u32 split(Iterator* boundaries, u32 max_chunks)
+	{
+		boundaries[0] = begin();
+		if (count == 0 || max_chunks == 0)
+			return 0;
+
+		u32 chunks = 0;
+		for (u32 chunk = 1; chunk <= max_chunks; chunk++) {
+			u32 position = static_cast<u32>(static_cast<u64>(capacity) * chunk / max_chunks);
+			while (position < capacity && control[position] < 0)
+				++position;
+
+			if (position != boundaries[chunks]._Get_Position())
+				boundaries[++chunks] = Iterator{ control, slots, position, capacity };
+		}
+
+		return chunks;
+	}
+
+	Iterator find(Key key)
+	{
+		const u32 position = find_position(key, hash_key(key));
+		return position != NULL_POSITION ? Iterator{ control, slots, position, capacity } : end();
+	}
+
+	ConstIterator find(Key key) const
+	{
+		const u32 position = find_position(key, hash_key(key));
+		return position != NULL_POSITION ? ConstIterator{ control, slots, position, capacity } : cend();
+	}
+
+	Iterator begin()
+	{
+		return Iterator{ control, slots, first_position(), capacity };
+	}
+
+	Iterator end()
+	{
+		return Iterator{ control, slots, capacity, capacity };
+	}
+
+	Iterator cbegin() const
+	{
+		return Iterator{ control, slots, first_position(), capacity };
+	}
+
+	Iterator cend() const
+	{
+		return Iterator{ control, slots, capacity, capacity };
+	}
+
+	Type& operator[](Key index)
+	{
+		static_assert(std::is_default_constructible_v<Type>, "building objects without default constructors via the [] operator is not possible");
+		const u64 hash = hash_key(index);
+		u32 position = find_position(index, hash);
+		if (position == NULL_POSITION) {
+			position = prepare_insert(hash);
+			slots[position].key = index;
+			new (slots[position].content) Type{};
+		}
+
+		return slots[position].value();
+	}
+
+	const Type& operator[](const Key index) const
+	{
+		return get_at(index);
+	}
+
+private:
+	//Keys are often sequential entity ids, the finalizer of murmur3 spreads them over all bits
+	static u64 hash_key(Key key)
+	{
+		u64 hash = static_cast<u64>(key);
+		hash ^= hash >> 33;
+		hash *= 0xFF51AFD7ED558CCD;
+		hash ^= hash >> 33;
+		hash *= 0xC4CEB9FE1A85EC53;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	static s8 control_hash(u64 hash)
+	{
+		return static_cast<s8>(hash & 0x7F);
+	}
+
+	//7/8 of the slots at most are used, full or deleted
+	static u32 max_load(u32 slot_count)
+	{
+		return slot_count - slot_count / 8;
+	}
+
+	//Groups are visited with triangular steps, which covers all of them when their count is a power of two
+	template<class Func>
+	u32 probe(u64 hash, Func&& func) const
+	{
+		const u32 group_mask = capacity / ControlGroup::SIZE - 1;
+		u32 group = static_cast<u32>(hash >> 7) & group_mask;
+		for (u32 step = 1;; step++) {
+			const u32 position = func(group * ControlGroup::SIZE);
+			if (position != NULL_POSITION)
+				return position;
+
+			group = (group + step) & group_mask;
+		}
+	}
+
+	u32 find_position(Key key, u64 hash) const
+	{
+		if (capacity == 0)
+			return NULL_POSITION;
+
+		u32 result = NULL_POSITION;
+		probe(hash, [&](u32 first) {
+			const ControlGroup group{ control + first };
+			for (u32 mask = group.match(control_hash(hash)); mask != 0; mask &= mask - 1) {
+				const u32 position = first + ControlGroup::lowest_bit(mask);
+				if (slots[position].key == key) {
+					result = position;
+					return position;
+				}
+			}
+
+			//An empty slot ends the probe sequence, the key would have been stored here
+			return group.match_empty() != 0 ? first : NULL_POSITION;
+		});
+
+		return result;
+	}
+
+	u32 find_insert_position(u64 hash) const
+	{
+		return probe(hash, [&](u32 first) {
+			const u32 mask = ControlGroup{ control + first }.match_empty_or_deleted();
+			return mask != 0 ? first + ControlGroup::lowest_bit(mask) : NULL_POSITION;
+		});
+	}
+
+	//Claims a slot for a key known to be missing, the caller constructs key and value
+	u32 prepare_insert(u64 hash)
+	{
+		if (capacity == 0)
+			rehash(MIN_CAPACITY);
+
+		u32 position = find_insert_position(hash);
+		if (growth_left == 0 && control[position] == static_cast<s8>(SlotState::Empty)) {
+			//Mostly deleted slots are reclaimed in place, otherwise the table doubles
+			rehash(count * 2 < max_load(capacity) ? capacity : capacity * 2);
+			position = find_insert_position(hash);
+		}
+
+		if (control[position] == static_cast<s8>(SlotState::Empty))
+			--growth_left;
+
+		control[position] = control_hash(hash);
+		++count;
+		return position;
+	}
+
+	void erase_at(u32 position)
+	{
+		assert(position < capacity && control[position] >= 0);
+		slots[position].value().~Type();
+
+		//Probes only continue past full groups, once a group has an empty slot no probe
+		//sequence goes through it and the erased slot can become empty again
+		const u32 first = position / ControlGroup::SIZE * ControlGroup::SIZE;
+		if (ControlGroup{ control + first }.match_empty() != 0) {
+			control[position] = static_cast<s8>(SlotState::Empty);
+			++growth_left;
+		}
+		else {
+			control[position] = static_cast<s8>(SlotState::Deleted);
+		}
+
+		--count;
+	}
+
+	u32 first_position() const
+	{
+		u32 position = 0;
+		while (position < capacity && control[position] < 0)
+			++position;
+
+		return position;
+	}
+
+	void rehash(u32 new_capacity)
+	{
+		s8* old_control = control;
+		Slot* old_slots = slots;
+		const u32 old_capacity = capacity;
+
+		control = resource->allocate_array<s8>(new_capacity);
+		std::memset(control, static_cast<u8>(SlotState::Empty), new_capacity);
+		slots = resource->allocate_array<Slot>(new_capacity);
+		capacity = new_capacity;
+		growth_left = max_load(new_capacity) - count;
+
+		for (u32 i = 0; i < old_capacity; i++) {
+			if (old_control[i] < 0)
+				continue;
+
+			const u64 hash = hash_key(old_slots[i].key);
+			const u32 position = find_insert_position(hash);
+			control[position] = control_hash(hash);
+			slots[position].key = old_slots[i].key;
+			new (slots[position].content) Type(std::move(old_slots[i].value()));
+			old_slots[i].value().~Type();
+		}
+
+		resource->deallocate_array(old_control, old_capacity);
+		resource->deallocate_array(old_slots, old_capacity);
+	}
+
+	void release()
+	{
+		for (u32 i = 0; i < capacity; i++) {
+			if (control[i] >= 0)
+				slots[i].value().~Type();
+		}
+
+		resource->deallocate_array(control, capacity);
+		resource->deallocate_array(slots, capacity);
+	}
+
+private:
+	static constexpr u32 MIN_CAPACITY   = ControlGroup::SIZE;
+	static constexpr u32 NULL_POSITION  = 0xFFFFFFFF;
+
+	MemoryResource* resource = &default_resource();
+	s8* control = nullptr;
+	Slot* slots = nullptr;
+	u32 count = 0, capacity = 0, growth_left = 0;
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <new>
+#include "types.h"
+
+//Source of the memory of the containers, from the tree nodes and their payloads to the dense
+//arrays and the sparse pages. Derive from it to place the ECS data in custom pools, e.g. NUMA
+//local or huge page backed ones. deallocate always gets the size and alignment given to the
+//matching allocate. A resource shared by registries living on different threads, or given to
+//a Registry using create_entity_concurrent, needs to be thread safe
+class MemoryResource
+{
+public:
+	MemoryResource() = default;
+	MemoryResource(const MemoryResource&) = delete;
+	MemoryResource& operator=(const MemoryResource&) = delete;
+	virtual ~MemoryResource() = default;
+
+	//alignment is a power of two
+	virtual void* allocate(u64 bytes, u64 alignment) = 0;
+	virtual void deallocate(void* memory, u64 bytes, u64 alignment) = 0;
+
+	template<class Type>
+	Type* allocate_array(u64 count)
+	{
+		return static_cast<Type*>(allocate(sizeof(Type) * count, alignof(Type)));
+	}
+
+	//Null is ignored like with operator delete
+	template<class Type>
+	void deallocate_array(Type* memory, u64 count)
+	{
+		if (memory != nullptr)
+			deallocate(memory, sizeof(Type) * count, alignof(Type));
+	}
+};
+
+//Global operator new and delete, the default of every container
+class HeapResource final : public MemoryResource
+{
+public:
+	void* allocate(u64 bytes, u64 alignment) override
+	{
+		return ::operator new(bytes, std::align_val_t{ alignment });
+	}
+
+	void deallocate(void* memory, u64, u64 alignment) override
+	{
+		::operator delete(memory, std::align_val_t{ alignment });
+	}
+};
+
+inline MemoryResource& default_resource()
+{
+	static HeapResource heap;
+	return heap;
+}
+
+//Sizes are the requested ones, bytes_peak is the highest bytes_live reached
+struct MemoryStats
+{
+	u64 allocations;
+	u64 deallocations;
+	u64 bytes_allocated;
+	u64 bytes_live;
+	u64 bytes_peak;
+};
+
+//Layout of a container as returned by its memory_usage(), gathered in O(1) or O(log n)
+//without visiting the elements. node_bytes is the structure: tree nodes, leaves, keys, control
+//bytes and sparse pages, with the values stored inside them. payload_bytes is what is held for
+//the values in arrays or blocks of their own. capacity - size slots are allocated but unused
+struct ContainerStats
+{
+	u64 size;
+	u64 capacity;
+	u64 node_bytes;
+	u64 payload_bytes;
+	//Upper bound of the number of nodes on a root to leaf path, 0 when not a tree
+	u32 height;
+};
+
+//Forwards to upstream and counts what goes through it. Every TypeStorage has its own, which
+//gives per component statistics whatever resource the types share. The counters are plain,
+//like the storage they belong to it is only used from one thread at a time
+class TrackedResource final : public MemoryResource
+{
+public:
+	explicit TrackedResource(MemoryResource& upstream) : upstream{upstream} {}
+
+	void* allocate(u64 bytes, u64 alignment) override
+	{
+		void* memory = upstream.allocate(bytes, alignment);
+		++counters.allocations;
+		counters.bytes_allocated += bytes;
+		counters.bytes_live += bytes;
+		if (counters.bytes_live > counters.bytes_peak)
+			counters.bytes_peak = counters.bytes_live;
+
+		return memory;
+	}
+
+	void deallocate(void* memory, u64 bytes, u64 alignment) override
+	{
+		upstream.deallocate(memory, bytes, alignment);
+		++counters.deallocations;
+		counters.bytes_live -= bytes;
+	}
+
+	const MemoryStats& stats() const { return counters; }
+	MemoryResource& upstream_resource() const { return upstream; }
+
+private:
+	MemoryResource& upstream;
+	MemoryStats counters{};
+};
@@ -1,8 +1,13 @@
 #pragma once
+#include <new>
 #include <type_traits>
+#include <utility>
+#include <cstring>
 #include "types.h"
+#include "memory_resource.h"
 
-//Store contiguously data of a specific type
+//Store contiguously data of a specific type, released slots are chained in an
+//intrusive free list so both allocation and release are O(1). Buckets come from resource
 template <class Type>
 class BucketAllocator
 {
@@ -11,151 +16,141 @@ class BucketAllocator
 	//static_assert(std::is_default_destructible_v<Type>, "Type needs to be default constructible");
 public:
 	BucketAllocator() = default;
+	explicit BucketAllocator(MemoryResource& resource) : resource{&resource} {}
+	BucketAllocator(const BucketAllocator&) = delete;
+	BucketAllocator& operator=(const BucketAllocator&) = delete;
 
 	~BucketAllocator() 
 	{
-		_destroy(internal_storage);
+		reset();
 	}
 
+	//The returned memory is always zeroed
 	void* allocate_new()
 	{
-		if (internal_storage == nullptr) {
-			capacity = BUCKET_SIZE;
-			size = 0;
-			internal_storage = static_cast<BucketChain*>(::operator new(sizeof(BucketChain)));
-			internal_storage->next = nullptr;
-			std::memset(internal_storage, 0, sizeof(BucketChain));
-		}
-
-		if (size >= capacity) {
-			capacity += BUCKET_SIZE;
-			
-			BucketChain* iter = internal_storage;
-			while (iter->next) iter = iter->next;
-			iter->next = new BucketChain;
-			iter->next->next = nullptr;
-		}
+		if (free_list == nullptr)
+			grow();
 
+		BucketValue* slot = free_list;
+		free_list = slot->next_free;
 		++size;
-		u32 index = 0;
-		BucketChain* iter = internal_storage;
-		for (; index < capacity; index++) {
-			if (index != 0 && index % BUCKET_SIZE == 0) {
-				iter = iter->next;
-				assert(iter != nullptr);
-				index %= 64;
-			}
 
-			if (iter->bucket[index].memory_state != MEMORY_USED)
-				break;
-		}
-
-		if(iter->bucket[index].memory_state & MEMORY_DIRTY)
-			std::memset(&iter->bucket[index].allocated, 0, sizeof(Type));
-
-		iter->bucket[index].memory_state = MEMORY_USED;
-		return &iter->bucket[index].allocated;
+		std::memset(slot->allocated, 0, sizeof(Type));
+		return slot->allocated;
 	}
 
 	void free(void* memory, bool clear_mem = false)
 	{
-		BucketChain* iter = internal_storage;
-		for (u32 index = 0; index < capacity; index++) {
-			if (index != 0 && index % BUCKET_SIZE == 0) {
-				iter = iter->next;
-				assert(iter != nullptr);
-				index %= 64;
-			}
+		if (memory == nullptr)
+			return;
 
-			if (&iter->bucket[index].allocated == memory) {
-				if (clear_mem) {
-					std::memset(&iter->bucket[index].allocated, 0, sizeof(Type));
-					iter->bucket[index].memory_state = MEMORY_NOT_USED;
-				}
-				else {
-					iter->bucket[index].memory_state = MEMORY_DIRTY;
-				}
-				break;
-			}
-		}
+		//allocated sits at offset 0, the slot is the pointer itself
+		BucketValue* slot = reinterpret_cast<BucketValue*>(memory);
+		if (clear_mem)
+			std::memset(slot->allocated, 0, sizeof(Type));
+
+		slot->next_free = free_list;
+		free_list = slot;
+		--size;
 	}
 
-private:
+	//Releases every bucket at once, whatever was allocated needs to be destroyed already
+	void reset()
+	{
+		while (internal_storage) {
+			BucketChain* next = internal_storage->next;
+			resource->deallocate_array(internal_storage, 1);
+			internal_storage = next;
+		}
+
+		free_list = nullptr;
+		capacity = 0;
+		size = 0;
+	}
 
+	//Slots in the buckets, used or on the free list, and the bytes of the buckets
+	u32 slots() const { return capacity; }
+	u64 bytes_reserved() const { return static_cast<u64>(capacity / BUCKET_SIZE) * sizeof(BucketChain); }
 
-	void _destroy(BucketChain* chain) 
+private:
+	void grow()
 	{
-		if (chain == nullptr)
-			return;
+		BucketChain* chain = resource->allocate_array<BucketChain>(1);
+		chain->next = internal_storage;
+		internal_storage = chain;
+		capacity += BUCKET_SIZE;
 
-		_destroy(chain->next);
-		::operator delete[](chain);
+		//Thread the new slots in address order so consecutive allocations stay adjacent
+		for (u32 index = 0; index < BUCKET_SIZE; index++)
+			chain->bucket[index].next_free = index + 1 < BUCKET_SIZE ? &chain->bucket[index + 1] : free_list;
+
+		free_list = &chain->bucket[0];
 	}
 
 private:
-	static constexpr u8 MEMORY_NOT_USED = 0x00;
-	static constexpr u8 MEMORY_USED     = 0x01;
-	static constexpr u8 MEMORY_DIRTY    = 0x02;
 	static constexpr u8 BUCKET_SIZE     = 64;
 
-	struct BucketValue
+	union BucketValue
 	{
-		u8 memory_state;
-		Type allocated;
+		alignas(Type) u8 allocated[sizeof(Type)];
+		BucketValue* next_free;
 	};
 
 	struct BucketChain
 	{
 		BucketValue bucket[BUCKET_SIZE];
-		BucketChain* next = nullptr;
+		BucketChain* next;
 	};
 
+	MemoryResource* resource = &default_resource();
 	BucketChain* internal_storage = nullptr;
+	BucketValue* free_list = nullptr;
 	u32 capacity = 0, size = 0;
-
-
 };
 
 enum class Color { Black = 0, Red };
 
-template<typename Type, typename Index = u64>
-struct TreeNode
+//Links and ordering shared by every node layout, with Threaded the tree also keeps
+//the in order neighbours and the subtree size of every node
+template<typename Node, typename Index, bool Threaded>
+struct TreeNodeBase
 {
+	static constexpr bool THREADED = false;
+
 	Color color;
 	Index index;
-	Type* content;
-	TreeNode* left, * right, * parent;
+	Node* left, * right, * parent;
 
-	TreeNode* find_next()
+	Node* find_next()
 	{
-		TreeNode* node = this;
+		Node* node = static_cast<Node*>(this);
 		if (node->right) {
-			TreeNode* sub_node = node->right;
+			Node* sub_node = node->right;
 			while (sub_node->left)
 				sub_node = sub_node->left;
 
 			return sub_node;
 		}
 
-		TreeNode* sub_node = node->parent;
+		Node* sub_node = node->parent;
 		while (sub_node && sub_node->index < index)
 			sub_node = sub_node->parent;
 
 		return sub_node;
 	}
 
-	TreeNode* find_prev()
+	Node* find_prev()
 	{
-		TreeNode* node = this;
+		Node* node = static_cast<Node*>(this);
 		if (node->left) {
-			TreeNode* sub_node = node->left;
+			Node* sub_node = node->left;
 			while (sub_node->right)
 				sub_node = sub_node->right;
 
 			return sub_node;
 		}
 
-		TreeNode* sub_node = node->parent;
+		Node* sub_node = node->parent;
 		while (sub_node && sub_node->index > index)
 			sub_node = sub_node->parent;
 
@@ -163,13 +158,107 @@ struct TreeNode
 	}
 };
 
-template<typename Type, typename Index = u64, class Allocator = BucketAllocator<TreeNode<Type, Index>>>
+//Stepping is a single load instead of a walk along the parents, and the sizes give
+//positional access in O(log n), see RedBlackTree::nth_node and RedBlackTree::rank
+template<typename Node, typename Index>
+struct TreeNodeBase<Node, Index, true>
+{
+	static constexpr bool THREADED = true;
+
+	Color color;
+	Index index;
+	Node* left, * right, * parent;
+	Node* next, * prev;
+	u32 subtree_size;
+
+	Node* find_next() { return next; }
+	Node* find_prev() { return prev; }
+};
+
+//The content is a separate block of the tree resource, its address never changes while the element lives
+template<typename Type, typename Index, bool Threaded>
+struct BasicTreeNode : TreeNodeBase<BasicTreeNode<Type, Index, Threaded>, Index, Threaded>
+{
+	//Bytes allocated apart from the node for every element
+	static constexpr u64 PAYLOAD_SIZE = sizeof(Type);
+
+	Type* content;
+
+	template<class... Args>
+	void construct(MemoryResource& resource, Args&&... args)
+	{
+		content = resource.allocate_array<Type>(1);
+		new (content) Type{ std::forward<Args>(args)... };
+	}
+
+	void destroy(MemoryResource& resource)
+	{
+		content->~Type();
+		resource.deallocate_array(content, 1);
+	}
+
+	void swap_content(BasicTreeNode* other)
+	{
+		Type* tmp = content;
+		content = other->content;
+		other->content = tmp;
+	}
+
+	Type& value() { return *content; }
+};
+
+//The content is stored in the node itself: one allocation per element and one
+//cache line less per access, but erasing an element may move the value of another
+template<typename Type, typename Index, bool Threaded>
+struct BasicInlineTreeNode : TreeNodeBase<BasicInlineTreeNode<Type, Index, Threaded>, Index, Threaded>
+{
+	static constexpr u64 PAYLOAD_SIZE = 0;
+
+	alignas(Type) u8 content[sizeof(Type)];
+
+	template<class... Args>
+	void construct(MemoryResource&, Args&&... args)
+	{
+		new (content) Type{ std::forward<Args>(args)... };
+	}
+
+	void destroy(MemoryResource&)
+	{
+		value().~Type();
+	}
+
+	void swap_content(BasicInlineTreeNode* other)
+	{
+		Type tmp(std::move(value()));
+		value() = std::move(other->value());
+		other->value() = std::move(tmp);
+	}
+
+	Type& value() { return *std::launder(reinterpret_cast<Type*>(content)); }
+};
+
+template<typename Type, typename Index = u64>
+using TreeNode =                BasicTreeNode<Type, Index, false>;
+template<typename Type, typename Index = u64>
+using InlineTreeNode =          BasicInlineTreeNode<Type, Index, false>;
+//Two more pointers and a counter per node for O(1) iterator steps and positional access
+template<typename Type, typename Index = u64>
+using ThreadedTreeNode =        BasicTreeNode<Type, Index, true>;
+template<typename Type, typename Index = u64>
+using ThreadedInlineTreeNode =  BasicInlineTreeNode<Type, Index, true>;
+
+//Node selects the layout of the elements, TreeNode, InlineTreeNode or one of their threaded versions.
+//The nodes, the TreeNode payloads and the scratch arrays come from resource, Allocator needs
+//to be constructible from it and to report its slots() and bytes_reserved()
+template<typename Type, typename Index = u64, template<class, class> class Node = TreeNode, class Allocator = BucketAllocator<Node<Type, Index>>>
 class RedBlackTree
 {
 	static_assert(std::is_integral_v<Index>, "Index needs to be of integral type");
-	using NodeType = TreeNode<Type, Index>;
+	using NodeType = Node<Type, Index>;
+	static constexpr bool THREADED = NodeType::THREADED;
 public:
-	RedBlackTree() : root{ nullptr }, node_count{0} {}
+	RedBlackTree() : RedBlackTree(default_resource()) {}
+	explicit RedBlackTree(MemoryResource& resource) : root{ nullptr }, node_count{0}, resource{&resource}, alloc{resource} {}
 
 	~RedBlackTree()
 	{
@@ -187,8 +276,11 @@ public:
 
 			root->color = Color::Black;
 			root->index = value;
-			root->content = new Type{ std::forward<Args>(args)... };
-			return *root->content;
+			if constexpr (THREADED)
+				root->subtree_size = 1;
+
+			root->construct(*resource, std::forward<Args>(args)...);
+			return root->value();
 		}
 
 		NodeType* node = nullptr;
@@ -197,6 +289,9 @@ public:
 			NodeType** _iter = &root;
 			NodeType* _parent = nullptr;
 			while (*_iter != nullptr) {
+				if constexpr (THREADED)
+					++(*_iter)->subtree_size;
+
 				if (value > (*_iter)->index) {
 					_parent = *_iter;
 					_iter = &(*_iter)->right;
@@ -211,20 +306,92 @@ public:
 			(*_iter)->color = Color::Red;
 			(*_iter)->parent = _parent;
 			(*_iter)->index = value;
-			(*_iter)->content = new Type{ std::forward<Args>(args)... }; 
+			(*_iter)->construct(*resource, std::forward<Args>(args)...);
 
 			node = *_iter;
+			if constexpr (THREADED) {
+				node->subtree_size = 1;
+				const bool is_left = _parent->left == node;
+				node->prev = is_left ? _parent->prev : _parent;
+				node->next = is_left ? _parent : _parent->next;
+				if (node->prev != nullptr)
+					node->prev->next = node;
+				if (node->next != nullptr)
+					node->next->prev = node;
+			}
 		}
 
 		//No need to fixup
 		if (node->parent->color == Color::Black)
-			return *node->content;
+			return node->value();
 
+		//Rotations do not move contents, node still holds the new element
 		emplace_node_fixup(node);
-		return *node->content;
+		return node->value();
+	}
+
+	//[first, last) needs to be sorted, unique and absent from the tree, make(offset)
+	//returns the value for first[offset]. When the batch is big compared to the tree
+	//the old and new nodes are merged and the tree is rebuilt balanced in linear time
+	template<class IndexIt, class Make>
+	void emplace_sorted(IndexIt first, IndexIt last, Make&& make)
+	{
+		const u32 count = static_cast<u32>(last - first);
+		if (count == 0)
+			return;
+
+		const u32 existing = node_count;
+		const u32 total = existing + count;
+		if (static_cast<u64>(count) * (floor_log2(total) + 1) < existing) {
+			for (u32 offset = 0; offset < count; offset++)
+				emplace_node(first[offset], make(offset));
+
+			return;
+		}
+
+		NodeType** nodes = resource->allocate_array<NodeType*>(total);
+		u32 read = 0;
+		for (NodeType* node = find_first(); node != nullptr; node = node->find_next())
+			nodes[read++] = node;
+
+		//Merge from the back so the existing nodes can be moved in place
+		u32 write = total;
+		for (u32 offset = count; offset > 0;) {
+			const Index index = first[offset - 1];
+			if (read > 0 && nodes[read - 1]->index > index) {
+				nodes[--write] = nodes[--read];
+				continue;
+			}
+
+			assert(read == 0 || nodes[read - 1]->index != index);
+			NodeType* node = static_cast<NodeType*>(alloc.allocate_new());
+			node->index = index;
+			node->construct(*resource, make(--offset));
+			nodes[--write] = node;
+		}
+
+		rebuild(nodes, total);
+		resource->deallocate_array(nodes, total);
+	}
+
+	u32 size() const
+	{
+		return node_count;
+	}
+
+	//Every path holds as many black nodes as the leftmost one and no two reds in a row,
+	//so the height is at most twice the black nodes found walking down the left spine
+	ContainerStats memory_usage() const
+	{
+		u32 black_height = 0;
+		for (const NodeType* node = root; node != nullptr; node = node->left)
+			black_height += node->color == Color::Black;
+
+		return ContainerStats{ node_count, alloc.slots(), alloc.bytes_reserved(),
+			node_count * NodeType::PAYLOAD_SIZE, root != nullptr ? 2 * black_height : 0 };
 	}
 
-	NodeType* find_node(Index index)
+	NodeType* find_node(Index index) const
 	{
 		NodeType* node = root;
 		while (node != nullptr && node->index != index) {
@@ -237,30 +404,83 @@ public:
 		return node;
 	}
 
-	NodeType* find_first() 
+	NodeType* find_first() const
 	{
-		assert(root != nullptr);
 		NodeType* node = root;
+		if (node == nullptr)
+			return nullptr;
+
 		while (node->left)
 			node = node->left;
 
 		return node;
 	}
 
-	NodeType* find_last()
+	NodeType* find_last() const
 	{
-		assert(root != nullptr);
 		NodeType* node = root;
+		if (node == nullptr)
+			return nullptr;
+
 		while (node->right)
 			node = node->right;
 
 		return node;
 	}
 
+	//Node at position in key order, null past the last one. Needs a threaded layout
+	NodeType* nth_node(u32 position) const
+	{
+		static_assert(THREADED, "positional access needs a threaded node layout");
+		NodeType* node = root;
+		while (node != nullptr) {
+			const u32 left_size = size_of(node->left);
+			if (position == left_size)
+				return node;
+
+			if (position < left_size) {
+				node = node->left;
+			}
+			else {
+				position -= left_size + 1;
+				node = node->right;
+			}
+		}
+
+		return nullptr;
+	}
+
+	//Number of indices lower than index, whether index is in the tree or not. Needs a threaded layout
+	u32 rank(Index index) const
+	{
+		static_assert(THREADED, "positional access needs a threaded node layout");
+		u32 result = 0;
+		NodeType* node = root;
+		while (node != nullptr) {
+			if (index <= node->index) {
+				node = node->left;
+			}
+			else {
+				result += size_of(node->left) + 1;
+				node = node->right;
+			}
+		}
+
+		return result;
+	}
+
+	//In order visit of the nodes above depth, with depth d up to 2^d - 1 nodes are
+	//visited, they partition the rest of the tree in subtrees of about the same size
+	template<class Func>
+	void visit_top_levels(u32 depth, Func&& func) const
+	{
+		visit_top_levels(root, depth, func);
+	}
+
 	void delete_node(Index index)
 	{
 		NodeType* node = root;
-		while(node == nullptr || node->index != index){
+		while(node != nullptr && node->index != index){
 			if(node->index < index)
 				node = node->right;
 			else
@@ -276,36 +496,125 @@ public:
 			return;
 
 		isolate_node(node);
+		if constexpr (THREADED) {
+			//The leaf counts as gone already so the rotations of the fixup get the right sizes
+			if (node->prev != nullptr)
+				node->prev->next = node->next;
+			if (node->next != nullptr)
+				node->next->prev = node->prev;
+
+			node->subtree_size = 0;
+			for (NodeType* ancestor = node->parent; ancestor != nullptr; ancestor = ancestor->parent)
+				--ancestor->subtree_size;
+		}
+
 		delete_node_fixup(node);
+		detach_terminal_node(node);
 		cleanup_terminal_node(node);
 
 		if (--node_count == 0)
 			root = nullptr;
 	}
 
-private:
-	void isolate_node(NodeType*& node)
+	//Destroys every element and gives the node memory back in whole buckets
+	void clear()
+	{
+		destroy_tree(root);
+		alloc.reset();
+		root = nullptr;
+		node_count = 0;
+	}
+
+	//Erases the nodes in [first, last), a null last erases up to the end. A range that is
+	//big compared to the tree is dropped while the remaining nodes are relinked balanced
+	void erase_range(NodeType* first, NodeType* last)
 	{
-		if (node->left == nullptr && node->right == nullptr) {
+		u32 count = 0;
+		for (NodeType* node = first; node != last; node = node->find_next()) {
+			assert(node != nullptr);
+			++count;
+		}
+
+		if (count == node_count) {
+			clear();
 			return;
 		}
-		else if (node->left == nullptr || node->right == nullptr) {
-			if (node->left != nullptr) {
-				swap_node_data(node, node->left);
-				node = node->left;
-			}
-			else {
-				swap_node_data(node, node->right);
-				node = node->right;
-			}
 
+		if (static_cast<u64>(count) * (floor_log2(node_count) + 1) < node_count) {
+			//Deleting may move contents between nodes, the indices stay valid meanwhile
+			Index* indices = resource->allocate_array<Index>(count);
+			u32 offset = 0;
+			for (NodeType* node = first; node != last; node = node->find_next())
+				indices[offset++] = node->index;
+
+			for (offset = 0; offset < count; offset++)
+				delete_node(indices[offset]);
+
+			resource->deallocate_array(indices, count);
 			return;
 		}
-		else {
-			//Node has both children
-			NodeType* iter = node->left;
-			while (iter->right)
-				iter = iter->right;
+
+		bool erasing = false;
+		rebuild_without([&](NodeType* node) {
+			if (node == first)
+				erasing = true;
+			if (node == last)
+				erasing = false;
+
+			return erasing;
+		});
+	}
+
+	//[first, last) needs to be sorted, indices missing from the tree are skipped.
+	//Same strategy as erase_range
+	template<class IndexIt>
+	void erase_sorted(IndexIt first, IndexIt last)
+	{
+		const u32 count = static_cast<u32>(last - first);
+		if (count == 0 || node_count == 0)
+			return;
+
+		if (static_cast<u64>(count) * (floor_log2(node_count) + 1) < node_count) {
+			for (; first != last; ++first)
+				delete_node(*first);
+
+			return;
+		}
+
+		rebuild_without([&](NodeType* node) {
+			while (first != last && *first < node->index)
+				++first;
+
+			return first != last && *first == node->index;
+		});
+	}
+
+private:
+	template<class Func>
+	static void visit_top_levels(NodeType* node, u32 depth, Func& func)
+	{
+		if (node == nullptr || depth == 0)
+			return;
+
+		visit_top_levels(node->left, depth - 1, func);
+		func(node);
+		visit_top_levels(node->right, depth - 1, func);
+	}
+
+	//Moves the data to delete down to a node without children
+	void isolate_node(NodeType*& node)
+	{
+		while (node->left != nullptr || node->right != nullptr) {
+			NodeType* iter = nullptr;
+			if (node->left != nullptr && node->right != nullptr) {
+				//Node has both children, swap with the predecessor
+				iter = node->left;
+				while (iter->right)
+					iter = iter->right;
+			}
+			else {
+				iter = node->left != nullptr ? node->left : node->right;
+			}
 
 			swap_node_data(node, iter);
 			node = iter;
@@ -314,134 +623,122 @@ private:
 
 	void emplace_node_fixup(NodeType* node)
 	{
-		//Insertion case 3
-		assert(node->parent != nullptr);
-		Color uncle_color = uncle_node(node) != nullptr ? uncle_node(node)->color : Color::Black;
-		Color father_color = node->parent->color;
-
-		if (father_color == Color::Red && uncle_color == Color::Red) {
-			//uncle exists if it is red
-			grandfather_node(node)->color = Color::Red;
-			uncle_node(node)->color = Color::Black;
-			node->parent->color = Color::Black;
-
-			if (grandfather_node(node->parent) == nullptr)
-				return;
-
-			//Check if the generated red gives problems
-			node = node->parent;
-			uncle_color = uncle_node(node) != nullptr ? uncle_node(node)->color : Color::Black;
-			father_color = node->parent->color;
-		}
+		while (node->parent != nullptr && node->parent->color == Color::Red) {
+			//A red parent is never the root, the grandfather exists
+			NodeType* parent = node->parent;
+			NodeType* grandfather = grandfather_node(node);
+			NodeType* uncle = uncle_node(node);
+
+			if (uncle != nullptr && uncle->color == Color::Red) {
+				//Recolor and check if the generated red gives problems higher up
+				parent->color = Color::Black;
+				uncle->color = Color::Black;
+				grandfather->color = Color::Red;
+				node = grandfather;
+				continue;
+			}
 
-		if (father_color == Color::Red && uncle_color == Color::Black) {
-			//Insertion case 4
-			if (node->parent->right == node && node->parent == grandfather_node(node)->left) {
+			//Bring the node on the same side its parent is of the grandfather
+			if (parent == grandfather->left && node == parent->right) {
 				rotate_left(node);
-				node = node->left;
+				node = parent;
+				parent = node->parent;
 			}
-			if (node->parent->left == node && node->parent == grandfather_node(node)->right) {
+			else if (parent == grandfather->right && node == parent->left) {
 				rotate_right(node);
-				node = node->right;
+				node = parent;
+				parent = node->parent;
 			}
 
-			//Insertion case 5
-			node->parent->color = Color::Black;
-			grandfather_node(node)->color = Color::Red;
-			if (node->parent->left == node && node->parent == grandfather_node(node)->left) {
-				rotate_right(node->parent);
-			}
-			if (node->parent->right == node && node->parent == grandfather_node(node)->right) {
-				rotate_left(node->parent);
-			}
+			parent->color = Color::Black;
+			grandfather->color = Color::Red;
+			if (node == parent->left)
+				rotate_right(parent);
+			else
+				rotate_left(parent);
 		}
+
+		root->color = Color::Black;
 	}
 
+	//The node is still linked in the tree and has no children, removing it
+	//would take one black from its path
 	void delete_node_fixup(NodeType* node)
 	{
-		if (node->parent == nullptr)
-			return;
+		NodeType* iter = node;
+		while (iter != root && iter->color == Color::Black) {
+			NodeType* parent = iter->parent;
+			NodeType* sibling = sibling_node(iter);
+			const bool is_left = parent->left == iter;
 
-		NodeType* parent = node->parent;
-		NodeType* sibling = sibling_node(node);
-		if (parent->left == node)
-			parent->left = nullptr;
-		else
-			parent->right = nullptr;
-
-
-		if (node->color == Color::Red)
-			return;
-		else if (node->color == Color::Black && parent->color == Color::Red) {
-			if (!sibling)
-				parent->color = Color::Black;
-			else {
-				if (sibling == parent->right)
+			if (sibling->color == Color::Red) {
+				sibling->color = Color::Black;
+				parent->color = Color::Red;
+				if (is_left)
 					rotate_left(sibling);
 				else
 					rotate_right(sibling);
+
+				sibling = is_left ? parent->right : parent->left;
 			}
-		}
-		else {
-			//Both black
-			assert(sibling != nullptr);
-			if (sibling->color == Color::Black) {
-				if (sibling->left != nullptr && sibling->left->color == Color::Red &&
-					parent->left == sibling) {
-					sibling->left->color = Color::Black;
-					rotate_right(sibling);
-				}
 
-				if (sibling->right != nullptr && sibling->right->color == Color::Red &&
-					parent->right == sibling) {
-					sibling->right->color = Color::Black;
-					rotate_left(sibling);
-				}
+			NodeType* near_nephew = is_left ? sibling->left : sibling->right;
+			NodeType* far_nephew = is_left ? sibling->right : sibling->left;
+			const bool near_red = near_nephew != nullptr && near_nephew->color == Color::Red;
+			const bool far_red = far_nephew != nullptr && far_nephew->color == Color::Red;
 
-				if (sibling->left != nullptr && sibling->left->color == Color::Red &&
-					parent->right == sibling) {
-					sibling->left->color = Color::Black;
-					rotate_left(sibling->left);
-					rotate_right(sibling->left);
-				}
+			if (!near_red && !far_red) {
+				sibling->color = Color::Red;
+				iter = parent;
+				continue;
+			}
 
-				if (sibling->right != nullptr && sibling->right->color == Color::Red &&
-					parent->left == sibling) {
-					sibling->right->color = Color::Black;
-					rotate_left(sibling->right);
-					rotate_right(sibling->right);
-				}
+			if (!far_red) {
+				near_nephew->color = Color::Black;
+				sibling->color = Color::Red;
+				if (is_left)
+					rotate_right(near_nephew);
+				else
+					rotate_left(near_nephew);
 
-				if ((sibling->right == nullptr || sibling->right->color == Color::Black) &&
-					(sibling->left == nullptr || sibling->left->color == Color::Black)) {
-					sibling->color = Color::Red;
-				}
-			}
-			else if (sibling->color == Color::Red) {
-				sibling->color = Color::Black;
-				if (parent->right == sibling) {
-					if (sibling->left) sibling->left->color = Color::Red;
-					rotate_left(sibling);
-				}
-				else {
-					if (sibling->right) sibling->right->color = Color::Red;
-					rotate_right(sibling);
-				}
+				far_nephew = sibling;
+				sibling = near_nephew;
 			}
+
+			sibling->color = parent->color;
+			parent->color = Color::Black;
+			far_nephew->color = Color::Black;
+			if (is_left)
+				rotate_left(sibling);
+			else
+				rotate_right(sibling);
+
+			iter = root;
 		}
+
+		iter->color = Color::Black;
+	}
+
+	void detach_terminal_node(NodeType* node)
+	{
+		if (node->parent == nullptr)
+			return;
+
+		if (node->parent->left == node)
+			node->parent->left = nullptr;
+		else
+			node->parent->right = nullptr;
 	}
 
 	void cleanup_terminal_node(NodeType* node)
 	{
-		delete node->content;
+		node->destroy(*resource);
 		alloc.free(node);
 	}
 
 	void swap_node_data(NodeType* first, NodeType* second)
 	{
-		Type* tmp = first->content;
-		first->content = second->content;
-		second->content = tmp;
+		first->swap_content(second);
 
 		Index index = first->index;
 		first->index = second->index;
@@ -471,6 +768,7 @@ private:
 
 		parent->right = node_left_branch;
 		if(node_left_branch != nullptr) node_left_branch->parent = parent;
+		update_sizes(parent, node);
 	}
 
 	void rotate_right(NodeType* node)
@@ -496,6 +794,21 @@ private:
 
 		parent->left = node_right_branch;
 		if (node_right_branch != nullptr) node_right_branch->parent = parent;
+		update_sizes(parent, node);
+	}
+
+	//After a rotation that moved node above parent, node takes the size parent had
+	void update_sizes(NodeType* parent, NodeType* node)
+	{
+		if constexpr (THREADED) {
+			node->subtree_size = parent->subtree_size;
+			parent->subtree_size = size_of(parent->left) + size_of(parent->right) + 1;
+		}
+	}
+
+	static u32 size_of(const NodeType* node)
+	{
+		return node != nullptr ? node->subtree_size : 0;
 	}
 
 	inline NodeType* grandfather_node(NodeType* node) 
@@ -522,6 +835,74 @@ private:
 	}
 
 private:
+	//remove(node) is called on every node in order, the removed ones are destroyed
+	//and the others relinked into a balanced tree
+	template<class Remove>
+	void rebuild_without(Remove&& remove)
+	{
+		const u32 capacity = node_count;
+		NodeType** nodes = resource->allocate_array<NodeType*>(capacity);
+		u32 count = 0;
+		for (NodeType* node = find_first(); node != nullptr; node = node->find_next())
+			nodes[count++] = node;
+
+		//The links are only read above, the nodes can be released in any order now
+		u32 kept = 0;
+		for (u32 offset = 0; offset < count; offset++) {
+			if (remove(nodes[offset])) {
+				nodes[offset]->destroy(*resource);
+				alloc.free(nodes[offset]);
+			}
+			else {
+				nodes[kept++] = nodes[offset];
+			}
+		}
+
+		rebuild(nodes, kept);
+		resource->deallocate_array(nodes, capacity);
+	}
+
+	//Links the sorted nodes into a perfectly balanced tree, every level is full but the
+	//deepest one, which is colored red when incomplete so every path has the same black count
+	void rebuild(NodeType** nodes, u32 count)
+	{
+		const u32 red_depth = (count & (count + 1)) == 0 ? NO_RED_DEPTH : floor_log2(count);
+		root = build_balanced(nodes, 0, count, 0, red_depth, nullptr);
+		node_count = count;
+		if constexpr (THREADED) {
+			for (u32 offset = 0; offset < count; offset++) {
+				nodes[offset]->prev = offset > 0 ? nodes[offset - 1] : nullptr;
+				nodes[offset]->next = offset + 1 < count ? nodes[offset + 1] : nullptr;
+			}
+		}
+	}
+
+	NodeType* build_balanced(NodeType** nodes, u32 first, u32 last, u32 depth, u32 red_depth, NodeType* parent)
+	{
+		if (first >= last)
+			return nullptr;
+
+		const u32 middle = first + (last - first) / 2;
+		NodeType* node = nodes[middle];
+		node->parent = parent;
+		node->color = depth == red_depth ? Color::Red : Color::Black;
+		node->left = build_balanced(nodes, first, middle, depth + 1, red_depth, node);
+		node->right = build_balanced(nodes, middle + 1, last, depth + 1, red_depth, node);
+		if constexpr (THREADED)
+			node->subtree_size = last - first;
+
+		return node;
+	}
+
+	static u32 floor_log2(u32 value)
+	{
+		u32 result = 0;
+		while (value >>= 1)
+			++result;
+
+		return result;
+	}
+
 	void destroy_tree(NodeType* node)
 	{
 		if (node == nullptr)
@@ -530,17 +911,17 @@ private:
 		destroy_tree(node->left);
 		destroy_tree(node->right);
 		
-		if (node->content) {
-			node->content->~Type();
-			delete node->content;
-		}
+		node->destroy(*resource);
 		
 		//alloc.free(Node);
 		//dont bother with the deletion, we free everything at the end
 	}
 
 private:
+	static constexpr u32 NO_RED_DEPTH = 0xFFFFFFFF;
+
 	NodeType* root;
 	u32 node_count;
+	MemoryResource* resource;
 	Allocator alloc;
 };
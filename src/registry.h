@@ -0,0 +1,1591 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include "dense_map.h"
+#include "btree_map.h"
+#include "sparse_set.h"
+#include "flat_map.h"
+#include "soa_set.h"
+#include "transient_set.h"
+#include "component_ticks.h"
+#include "entity.h"
+#include "type_id.h"
+#include "thread_pool.h"
+#include "snapshot.h"
+
+//Memory held by the storage of one component type, see Registry::storage_stats. The ticks
+//are kept apart from the components, allocations counts both
+struct StorageStats
+{
+	std::string_view name;
+	u64 hash_of_type;
+	ContainerStats components;
+	ContainerStats ticks;
+	MemoryStats allocations;
+};
+
+//Basic container used to store user defined types
+struct GenericStorage 
+{
+	GenericStorage(u64 hash_of_type) : hash_of_type{ hash_of_type } {}
+	virtual ~GenericStorage() = default;
+
+	//Type erased access used when the component type is not known, e.g. destroying an entity
+	virtual bool contains(u64 entity) const = 0;
+	virtual void destroy(u64 entity) = 0;
+	//Entities need to be sorted, the ones without the component are skipped
+	virtual void destroy_sorted(const u64* first, const u64* last) = 0;
+
+	//Size of one component in a snapshot, 0 if the type cannot be saved
+	virtual u32 snapshot_value_size() const = 0;
+	//Fills entry, false if the type cannot be saved
+	virtual bool save(SnapshotWriter& writer, SnapshotStorage& entry) const = 0;
+	//The storage needs to be empty and entry already checked against file
+	virtual void load(const MappedFile& file, const SnapshotStorage& entry) = 0;
+	//Writes the components changed after since as Components records
+	virtual void save_delta(DeltaWriter& writer, u32 since) const = 0;
+	//Adds or replaces the components of a Components record whose header has been read
+	virtual bool load_delta(DeltaReader& reader, const DeltaRecord& record) = 0;
+	virtual void clear() = 0;
+	virtual StorageStats storage_stats() const = 0;
+
+	const u64 hash_of_type;
+	//Removals since the last checkpoint, only recorded while the registry has one
+	std::vector<u64> removed;
+	bool cleared = false;
+};
+
+//View filters, only entities whose T was changed/added after the since tick are visited
+template<typename Type>
+struct Changed
+{
+	u32 since;
+};
+
+template<typename Type>
+struct Added
+{
+	u32 since;
+};
+
+//Runtime form of Changed and Added, checks the ticks without reading the components.
+//find gives the ticks of entity in storage, null when it does not have the component
+struct TickFilter
+{
+	const void* storage;
+	const ComponentTicks* (*find)(const void* storage, u64 entity);
+	u32 since;
+	bool on_added;
+
+	bool passes(u64 entity) const
+	{
+		const ComponentTicks* ticks = find(storage, entity);
+		if (ticks == nullptr)
+			return false;
+
+		return (on_added ? ticks->added : ticks->changed) > since;
+	}
+};
+
+//Specialize for a component type to pick the container backing its TypeStorage,
+//e.g. SparseSet<Type> for O(1) access and contiguous iteration, FlatMap<u64, Type> for
+//hashed lookups when iteration order does not matter, SoaSet<Type> for one array per field or
+//DenseMap<u64, Type, InlineTreeNode> to keep the ordered map without per component allocations.
+//BTreeMap<u64, Type> keeps the key order with packed leaves, for ordered scans of many components.
+//TransientSet<Type> is for components living one frame, they are dropped by Registry::end_frame
+template<typename Type>
+struct StorageTraits
+{
+	using MapType = DenseMap<u64, Type>;
+};
+
+template<typename Type, typename MapType = typename StorageTraits<Type>::MapType>
+class TypeStorage final : public GenericStorage
+{
+public:
+	using Iterator         =    typename MapType::Iterator;
+	using const_iterator   =    typename MapType::ConstIterator;
+	//Type& for most maps, a proxy object for SoaSet
+	using Reference        =    decltype(*std::declval<Iterator&>());
+
+	//world_tick is read whenever a component is added or accessed mutably, frame_arena backs
+	//the TransientSet storages and everything else is allocated from resource
+	TypeStorage(const u32& world_tick, MonotonicArena& frame_arena, MemoryResource& resource)
+		: GenericStorage(type_hash<Type>()), memory{ resource }, local_storage{ make_map(frame_arena, memory) },
+		component_ticks{ memory }, world_tick{ world_tick } {}
+	virtual ~TypeStorage() 
+	{
+	}
+
+	template<typename... Args>
+	decltype(auto) emplace(u64 entity, Args&&... args) {
+		assert(local_storage.find(entity) == local_storage.end());
+		decltype(auto) value = local_storage.emplace(entity, std::forward<Args>(args)...);
+		add_ticks(entity, ComponentTicks{ world_tick, world_tick });
+		return value;
+	}
+
+	//A replaced component keeps its added tick
+	template<typename... Args>
+	decltype(auto) emplace_or_replace(u64 entity, Args&&... args) {
+		u32 added = world_tick;
+		if (local_storage.find(entity) != local_storage.end()) {
+			added = ticks_at(entity).added;
+			local_storage.erase(entity);
+		}
+
+		decltype(auto) value = local_storage.emplace(entity, std::forward<Args>(args)...);
+		add_ticks(entity, ComponentTicks{ added, world_tick });
+		return value;
+	}
+
+	//The entities need to be sorted and without this component yet
+	template<typename EntityIt, typename... Args>
+	void emplace_sorted(EntityIt first, EntityIt last, const Args&... args) {
+		local_storage.emplace_sorted(first, last, args...);
+		add_ticks_sorted(first, last);
+	}
+
+	//Same requirements, entity first[i] takes the value moved out of values[i]
+	template<typename EntityIt, typename ValueIt>
+	void insert_sorted(EntityIt first, EntityIt last, ValueIt values) {
+		local_storage.insert_sorted(first, last, values);
+		add_ticks_sorted(first, last);
+	}
+
+	void destroy(u64 entity) override {
+		assert(local_storage.find(entity) != local_storage.end());
+		local_storage.erase(entity);
+		if constexpr (!TRANSIENT)
+			component_ticks.erase(entity);
+	}
+
+	void destroy(Iterator it) {
+		if constexpr (!TRANSIENT)
+			component_ticks.erase(it.index());
+		local_storage.erase(it);
+	}
+
+	void destroy_sorted(const u64* first, const u64* last) override {
+		destroy_sorted<const u64*>(first, last);
+	}
+
+	template<typename EntityIt>
+	void destroy_sorted(EntityIt first, EntityIt last) {
+		local_storage.erase_sorted(first, last);
+		if constexpr (!TRANSIENT)
+			component_ticks.erase_sorted(first, last);
+	}
+
+	void clear() override {
+		local_storage.clear();
+		if constexpr (!TRANSIENT)
+			component_ticks.clear();
+	}
+
+	//Only trivially copyable components fitting the snapshot alignment are saved
+	u32 snapshot_value_size() const override {
+		return std::is_trivially_copyable_v<Type> && alignof(Type) <= SNAPSHOT_ALIGN ? sizeof(Type) : 0;
+	}
+
+	//A SparseSet writes its dense arrays as they are, the other maps in key order
+	bool save(SnapshotWriter& writer, SnapshotStorage& entry) const override {
+		if constexpr (std::is_trivially_copyable_v<Type> && alignof(Type) <= SNAPSHOT_ALIGN) {
+			entry.type_hash = hash_of_type;
+			entry.count = local_storage.size();
+			entry.value_size = sizeof(Type);
+			if constexpr (is_sparse_set<MapType>::value) {
+				entry.keys = writer.write(local_storage.keys(), entry.count);
+				entry.values = writer.write(local_storage.data(), entry.count);
+			}
+			else {
+				std::vector<u64> keys;
+				keys.reserve(entry.count);
+				for (auto it = local_storage.cbegin(); it != local_storage.cend(); ++it)
+					keys.push_back(it.index());
+
+				std::sort(keys.begin(), keys.end());
+				std::vector<Type> values;
+				values.reserve(entry.count);
+				for (u64 key : keys)
+					values.push_back(local_storage.get_at(key));
+
+				entry.keys = writer.write(keys.data(), entry.count);
+				entry.values = writer.write(values.data(), entry.count);
+				if constexpr (TRANSIENT) {
+					//The ticks follow the keys just written
+					std::vector<ComponentTicks> ticks;
+					ticks.reserve(entry.count);
+					for (u64 key : keys)
+						ticks.push_back(*local_storage.find_ticks(key));
+
+					entry.tick_keys = entry.keys;
+					entry.ticks = writer.write(ticks.data(), entry.count);
+				}
+			}
+
+			if constexpr (!TRANSIENT) {
+				entry.tick_keys = writer.write(component_ticks.keys(), entry.count);
+				entry.ticks = writer.write(component_ticks.data(), entry.count);
+			}
+
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
+
+	//SparseSet storages and the ticks adopt the mapped arrays, the other maps copy them
+	void load(const MappedFile& file, const SnapshotStorage& entry) override {
+		if constexpr (std::is_trivially_copyable_v<Type> && alignof(Type) <= SNAPSHOT_ALIGN) {
+			assert(local_storage.size() == 0);
+			u64* keys = file.at<u64>(entry.keys);
+			Type* values = file.at<Type>(entry.values);
+			if constexpr (is_sparse_set<MapType>::value)
+				local_storage.adopt(keys, values, entry.count);
+			else
+				local_storage.insert_sorted(keys, keys + entry.count, values);
+
+			if constexpr (TRANSIENT) {
+				const u64* tick_keys = file.at<u64>(entry.tick_keys);
+				const ComponentTicks* ticks = file.at<ComponentTicks>(entry.ticks);
+				for (u32 i = 0; i < entry.count; i++)
+					local_storage.ticks_at(tick_keys[i]) = ticks[i];
+			}
+			else {
+				component_ticks.adopt(file.at<u64>(entry.tick_keys), file.at<ComponentTicks>(entry.ticks), entry.count);
+			}
+		}
+		else {
+			assert(false);
+		}
+	}
+
+	void save_delta(DeltaWriter& writer, u32 since) const override {
+		if constexpr (std::is_trivially_copyable_v<Type> && alignof(Type) <= SNAPSHOT_ALIGN) {
+			std::vector<u64> keys;
+			std::vector<Type> values;
+			std::vector<ComponentTicks> ticks;
+			auto write_chunk = [&]() {
+				const DeltaRecord record{ DeltaKind::Components, static_cast<u32>(keys.size()), hash_of_type, sizeof(Type), 0 };
+				writer.write(&record, 1);
+				writer.write(keys.data(), record.count);
+				writer.write(values.data(), record.count);
+				writer.write(ticks.data(), record.count);
+				keys.clear();
+				values.clear();
+				ticks.clear();
+			};
+
+			each_ticks([&](u64 entity, const ComponentTicks& stamp) {
+				if (stamp.changed <= since)
+					return;
+
+				keys.push_back(entity);
+				values.push_back(local_storage.get_at(entity));
+				ticks.push_back(stamp);
+				if (keys.size() == DELTA_CHUNK)
+					write_chunk();
+			});
+
+			if (!keys.empty())
+				write_chunk();
+		}
+	}
+
+	bool load_delta(DeltaReader& reader, const DeltaRecord& record) override {
+		if constexpr (std::is_trivially_copyable_v<Type> && alignof(Type) <= SNAPSHOT_ALIGN) {
+			if (record.value_size != sizeof(Type) || record.count > DELTA_CHUNK)
+				return false;
+
+			//Raw storage, Type does not need to be default constructible
+			std::vector<u64> keys(record.count);
+			std::vector<std::aligned_storage_t<sizeof(Type), alignof(Type)>> values(record.count);
+			std::vector<ComponentTicks> ticks(record.count);
+			if (!reader.read(keys.data(), record.count) ||
+				!reader.read(reinterpret_cast<u8*>(values.data()), record.count * static_cast<u32>(sizeof(Type))) ||
+				!reader.read(ticks.data(), record.count))
+				return false;
+
+			for (u32 i = 0; i < record.count; i++) {
+				const Type& value = *reinterpret_cast<const Type*>(&values[i]);
+				if (local_storage.contains(keys[i])) {
+					local_storage.get_at(keys[i]) = value;
+					ticks_at(keys[i]) = ticks[i];
+				}
+				else {
+					local_storage.emplace(keys[i], value);
+					add_ticks(keys[i], ticks[i]);
+				}
+			}
+
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
+
+	//Called by patch and the views, writes through column() spans of a SoaSet need to call it themselves
+	void mark_changed(u64 entity) {
+		ticks_at(entity).changed = world_tick;
+	}
+
+	const ComponentTicks& ticks_of(u64 entity) const {
+		const ComponentTicks* ticks = find_ticks(this, entity);
+		assert(ticks != nullptr);
+		return *ticks;
+	}
+
+	TickFilter tick_filter(u32 since, bool on_added) const {
+		return TickFilter{ this, &TypeStorage::find_ticks, since, on_added };
+	}
+
+	u32 size() const {
+		return local_storage.size();
+	}
+
+	u32 split(Iterator* boundaries, u32 max_chunks) {
+		return local_storage.split(boundaries, max_chunks);
+	}
+
+	bool contains(u64 entity) const override {
+		return local_storage.contains(entity);
+	}
+
+	decltype(auto) find(u64 entity) {
+		return local_storage.find(entity);
+	}
+
+	decltype(auto) find(u64 entity) const {
+		return local_storage.find(entity);
+	}
+
+	Iterator begin() {
+		return local_storage.begin();
+	}
+
+	Iterator end() {
+		return local_storage.end();
+	}
+
+	const_iterator begin() const {
+		return local_storage.begin();
+	}
+
+	const_iterator end() const {
+		return local_storage.end();
+	}
+
+	const_iterator cbegin() const {
+		return local_storage.begin();
+	}
+
+	const_iterator cend() const {
+		return local_storage.end();
+	}
+
+	//Leaves the ticks alone, so concurrent readers never write to the storage
+	decltype(auto) operator[](u64 key) {
+		return local_storage.get_at(key);
+	}
+
+	//Access meant for writing, the component is marked changed
+	decltype(auto) patch(u64 key) {
+		mark_changed(key);
+		return local_storage.get_at(key);
+	}
+
+	decltype(auto) operator[](u64 key) const {
+		return local_storage.get_at(key);
+	}
+
+	//Dense array access, only available when MapType is a SparseSet. The ticks
+	//then sit at the same dense position as their component
+	void swap(u64 first, u64 second) {
+		local_storage.swap(first, second);
+		component_ticks.swap(first, second);
+	}
+
+	void mark_changed_at(u32 position) {
+		component_ticks.data()[position].changed = world_tick;
+	}
+
+	u32 index_of(u64 entity) const {
+		return local_storage.index_of(entity);
+	}
+
+	Type* data() {
+		return local_storage.data();
+	}
+
+	const u64* keys() const {
+		return local_storage.keys();
+	}
+
+	//Components and ticks, the frame arena blocks are counted by the registry resource
+	const MemoryStats& memory_stats() const {
+		return memory.stats();
+	}
+
+	StorageStats storage_stats() const override {
+		//The ticks of a TransientSet are counted with its keys
+		const ContainerStats ticks = TRANSIENT ? ContainerStats{ local_storage.size(), local_storage.size(), 0, 0, 0 } : component_ticks.memory_usage();
+		return StorageStats{ type_name<Type>(), hash_of_type, local_storage.memory_usage(), ticks, memory.stats() };
+	}
+
+private:
+	static constexpr bool TRANSIENT = is_transient_set<MapType>::value;
+
+	static const ComponentTicks* find_ticks(const void* storage, u64 entity) {
+		const TypeStorage& self = *static_cast<const TypeStorage*>(storage);
+		if constexpr (TRANSIENT) {
+			return self.local_storage.find_ticks(entity);
+		}
+		else {
+			auto it = self.component_ticks.find(entity);
+			return it != self.component_ticks.cend() ? &*it : nullptr;
+		}
+	}
+
+	ComponentTicks& ticks_at(u64 entity) {
+		if constexpr (TRANSIENT)
+			return local_storage.ticks_at(entity);
+		else
+			return component_ticks.get_at(entity);
+	}
+
+	//The component of entity needs to be in local_storage already
+	void add_ticks(u64 entity, const ComponentTicks& ticks) {
+		if constexpr (TRANSIENT)
+			local_storage.ticks_at(entity) = ticks;
+		else
+			component_ticks.emplace(entity, ticks);
+	}
+
+	template<typename EntityIt>
+	void add_ticks_sorted(EntityIt first, EntityIt last) {
+		if constexpr (TRANSIENT) {
+			for (; first != last; ++first)
+				local_storage.ticks_at(*first) = ComponentTicks{ world_tick, world_tick };
+		}
+		else {
+			component_ticks.emplace_sorted(first, last, ComponentTicks{ world_tick, world_tick });
+		}
+	}
+
+	//func(u64 entity, const ComponentTicks& ticks) for every component
+	template<class Func>
+	void each_ticks(Func&& func) const {
+		if constexpr (TRANSIENT) {
+			for (auto it = local_storage.cbegin(); it != local_storage.cend(); ++it)
+				func(it.index(), *local_storage.find_ticks(it.index()));
+		}
+		else {
+			const u64* entities = component_ticks.keys();
+			const ComponentTicks* stamps = component_ticks.data();
+			for (u32 i = 0; i < component_ticks.size(); i++)
+				func(entities[i], stamps[i]);
+		}
+	}
+
+	static MapType make_map(MonotonicArena& frame_arena, MemoryResource& resource) {
+		if constexpr (is_transient_set<MapType>::value)
+			return MapType{ frame_arena, resource };
+		else
+			return MapType{ resource };
+	}
+
+private:
+	//Declared first, the containers give their memory back to it when destroyed
+	TrackedResource memory;
+	MapType local_storage;
+	//Kept apart from the components so filters never load them. Left empty for a TransientSet,
+	//which keeps the ticks in its chunks
+	SparseSet<ComponentTicks> component_ticks;
+	const u32& world_tick;
+};
+
+template<typename Type>
+static TypeStorage<Type>& storage_cast(const std::shared_ptr<GenericStorage>& storage)
+{
+	assert(storage != nullptr);
+	assert(storage->hash_of_type == type_hash<Type>());
+	return static_cast<TypeStorage<Type>&>(*storage);
+}
+
+//Joins several TypeStorage instances, the smallest one drives the iteration
+//and the others are only probed for the entities it contains. Accessing a
+//component marks it changed unless its type is listed const, e.g. View<const Velocity, Position>
+template<class... Types>
+class View
+{
+	static_assert(sizeof...(Types) > 0, "a view needs at least one component type");
+	template<class Type>
+	using StorageOf  =    TypeStorage<std::remove_const_t<Type>>;
+	//Const types are handed out as const Type& or, for proxies like SoaRef, as a const copy
+	template<class Type>
+	using ReferenceOf =   std::conditional_t<!std::is_const_v<Type>, typename StorageOf<Type>::Reference,
+		std::conditional_t<std::is_reference_v<typename StorageOf<Type>::Reference>,
+		const std::remove_reference_t<typename StorageOf<Type>::Reference>&, Type>>;
+	static_assert(((!std::is_const_v<Types> || !std::is_assignable_v<std::add_lvalue_reference_t<ReferenceOf<Types>>,
+		std::remove_const_t<Types>>) && ...), "components of const view types must not be assignable");
+
+	using Indices    =    std::index_sequence_for<Types...>;
+	using Storages   =    std::tuple<StorageOf<Types>*...>;
+	using Cursors    =    std::tuple<typename StorageOf<Types>::Iterator...>;
+	//Position of every component of the current entity in its storage
+	using Components =    Cursors;
+public:
+	class Iterator
+	{
+	public:
+		Iterator(View* view, Cursors cursors) : view{view}, cursors{cursors}, components{cursors}
+		{
+			skip_unmatched();
+		}
+
+		Iterator& operator++()
+		{
+			view->visit_lead([this](auto lead) { ++std::get<lead>(cursors); });
+			skip_unmatched();
+			return *this;
+		}
+
+		bool operator==(const Iterator& other) const
+		{
+			bool equal = false;
+			view->visit_lead([&](auto lead) { equal = std::get<lead>(cursors) == std::get<lead>(other.cursors); });
+			return equal;
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+		//Usable with structured bindings: auto [entity, first, second] = *it;
+		std::tuple<u64, ReferenceOf<Types>...> operator*() const
+		{
+			return dereference(Indices{});
+		}
+
+		u64 index() const
+		{
+			u64 entity = 0;
+			view->visit_lead([&](auto lead) { entity = std::get<lead>(cursors).index(); });
+			return entity;
+		}
+
+	private:
+		void skip_unmatched()
+		{
+			view->visit_lead([this](auto lead) {
+				auto& cursor = std::get<lead>(cursors);
+				const auto last = std::get<lead>(view->storages)->end();
+				for (; cursor != last; ++cursor) {
+					std::get<lead>(components) = cursor;
+					if (view->matches(cursor.index(), components))
+						break;
+				}
+			});
+		}
+
+		template<size_t... I>
+		std::tuple<u64, ReferenceOf<Types>...> dereference(std::index_sequence<I...>) const
+		{
+			const u64 entity = index();
+			view->mark_changed(entity, Indices{});
+			Components positions = components;
+			return std::tuple<u64, ReferenceOf<Types>...>{ entity, *std::get<I>(positions)... };
+		}
+
+	private:
+		View* view;
+		Cursors cursors;
+		Components components;
+	};
+
+public:
+	View(StorageOf<Types>&... storages) : storages{ &storages... }, lead{ smallest(Indices{}) } {}
+
+	Iterator begin()
+	{
+		return Iterator{ this, cursors(Indices{}, true) };
+	}
+
+	Iterator end()
+	{
+		return Iterator{ this, cursors(Indices{}, false) };
+	}
+
+	//Only the entities passing every filter are visited, see Changed and Added
+	void add_filter(const TickFilter& filter)
+	{
+		filters.push_back(filter);
+	}
+
+	//func(u64 entity, Types&... components), the lead storage is resolved once
+	//instead of on every step like the iterator does. Components stored in a
+	//SoaSet are passed as SoaRef proxies, or as const copies for const types
+	template<class Func>
+	void each(Func&& func)
+	{
+		visit_lead([&](auto lead) {
+			auto& storage = *std::get<lead>(storages);
+			Components components = cursors(Indices{}, false);
+			for (auto it = storage.begin(); it != storage.end(); ++it) {
+				std::get<lead>(components) = it;
+				if (matches(it.index(), components)) {
+					mark_changed(it.index(), Indices{});
+					invoke(func, it.index(), components, Indices{});
+				}
+			}
+		});
+	}
+
+	bool contains(u64 entity) const
+	{
+		if ((std::get<StorageOf<Types>*>(storages)->contains(entity) && ...)) {
+			for (const TickFilter& filter : filters) {
+				if (!filter.passes(entity))
+					return false;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	template<class Type>
+	decltype(auto) get(u64 entity)
+	{
+		if constexpr (std::is_const_v<Type>)
+			return static_cast<const StorageOf<Type>&>(*std::get<StorageOf<Type>*>(storages))[entity];
+		else
+			return std::get<StorageOf<Type>*>(storages)->patch(entity);
+	}
+
+	//Same as each but the lead storage is cut in at most max_chunks ranges processed on the
+	//pool. The cuts only depend on the storage contents and max_chunks, not on the thread
+	//count, so the work done per chunk is reproducible. func may only touch the components
+	//it receives
+	template<class Func>
+	void for_each_parallel(ThreadPool& pool, Func&& func, u32 max_chunks = PARALLEL_CHUNKS)
+	{
+		visit_lead([&](auto lead) {
+			auto& storage = *std::get<lead>(storages);
+			std::vector<typename std::remove_reference_t<decltype(storage)>::Iterator> boundaries(max_chunks + 1, storage.end());
+			const u32 chunks = storage.split(boundaries.data(), max_chunks);
+
+			pool.parallel_for(chunks, [&](u32 chunk) {
+				Components components = cursors(Indices{}, false);
+				for (auto it = boundaries[chunk]; it != boundaries[chunk + 1]; ++it) {
+					std::get<lead>(components) = it;
+					if (matches(it.index(), components)) {
+						mark_changed(it.index(), Indices{});
+						invoke(func, it.index(), components, Indices{});
+					}
+				}
+			});
+		});
+	}
+
+	//Upper bound of the entities visited, the size of the lead storage
+	u32 size_hint() const
+	{
+		u32 size = 0;
+		visit_lead([&](auto lead) { size = std::get<lead>(storages)->size(); });
+		return size;
+	}
+
+private:
+	template<class Func, size_t... I>
+	static void invoke(Func& func, u64 entity, Components& components, std::index_sequence<I...>)
+	{
+		func(entity, static_cast<ReferenceOf<Types>>(*std::get<I>(components))...);
+	}
+
+	template<class Func>
+	void visit_lead(Func&& func) const
+	{
+		visit_lead(func, Indices{});
+	}
+
+	template<class Func, size_t... I>
+	void visit_lead(Func& func, std::index_sequence<I...>) const
+	{
+		((lead == I ? func(std::integral_constant<size_t, I>{}) : void()), ...);
+	}
+
+	template<size_t... I>
+	u32 smallest(std::index_sequence<I...>) const
+	{
+		const u32 sizes[] = { std::get<I>(storages)->size()... };
+		u32 index = 0;
+		for (u32 i = 1; i < sizeof...(I); i++) {
+			if (sizes[i] < sizes[index])
+				index = i;
+		}
+
+		return index;
+	}
+
+	template<size_t... I>
+	Cursors cursors(std::index_sequence<I...>, bool at_begin) const
+	{
+		return Cursors{ (at_begin && I == lead ? std::get<I>(storages)->begin() : std::get<I>(storages)->end())... };
+	}
+
+	//The filters only read the ticks, the components are probed after them
+	bool matches(u64 entity, Components& components) const
+	{
+		for (const TickFilter& filter : filters) {
+			if (!filter.passes(entity))
+				return false;
+		}
+
+		return probe(entity, components, Indices{});
+	}
+
+	//Fills the non lead components of the entity, false if one of them is missing
+	template<size_t... I>
+	bool probe(u64 entity, Components& components, std::index_sequence<I...>) const
+	{
+		return (probe_one<I>(entity, components) && ...);
+	}
+
+	template<size_t I>
+	bool probe_one(u64 entity, Components& components) const
+	{
+		if (I == lead)
+			return true;
+
+		auto& storage = *std::get<I>(storages);
+		auto it = storage.find(entity);
+		if (it == storage.end())
+			return false;
+
+		std::get<I>(components) = it;
+		return true;
+	}
+
+	template<size_t... I>
+	void mark_changed(u64 entity, std::index_sequence<I...>) const
+	{
+		((std::is_const_v<Types> ? void() : std::get<I>(storages)->mark_changed(entity)), ...);
+	}
+
+private:
+	static constexpr u32 PARALLEL_CHUNKS = 64;
+
+	Storages storages;
+	u32 lead;
+	std::vector<TickFilter> filters;
+};
+
+//Type erased part of a group, called by Registry whenever one of the owned storages changes
+struct GroupBase
+{
+	GroupBase(u64 hash_of_group) : hash_of_group{ hash_of_group } {}
+	virtual ~GroupBase() = default;
+
+	//After the entity got one of the owned components
+	virtual void include(u64 entity) = 0;
+	//Before the entity loses one of the owned components
+	virtual void exclude(u64 entity) = 0;
+	//Before one of the owned storages is cleared
+	virtual void exclude_all() = 0;
+
+	const u64 hash_of_group;
+};
+
+//Owns the SparseSet storages of Owned and keeps the entities having all of them at the
+//front of every dense array in the same order, so iterating the group is a linear walk
+//over parallel arrays without any lookup. A storage can be owned by one group at most
+template<class... Owned>
+class Group final : public GroupBase
+{
+	static_assert(sizeof...(Owned) > 1, "a group needs at least two component types");
+	static_assert((is_sparse_set<typename StorageTraits<Owned>::MapType>::value && ...),
+		"grouped components need to be stored in a SparseSet, see StorageTraits");
+	using Storages = std::tuple<TypeStorage<Owned>*...>;
+public:
+	Group(TypeStorage<Owned>&... storages) : GroupBase(type_hash<Group>()), storages{ &storages... }, length{0}
+	{
+		//Swaps only move members into [0, length), the positions already visited stay visited
+		auto& lead = *std::get<0>(this->storages);
+		for (u32 position = 0; position < lead.size(); position++)
+			include(lead.keys()[position]);
+	}
+
+	void include(u64 entity) override
+	{
+		if (!contains_all(entity) || std::get<0>(storages)->index_of(entity) < length)
+			return;
+
+		(std::get<TypeStorage<Owned>*>(storages)->swap(entity, std::get<TypeStorage<Owned>*>(storages)->keys()[length]), ...);
+		++length;
+	}
+
+	void exclude(u64 entity) override
+	{
+		if (!contains_all(entity) || std::get<0>(storages)->index_of(entity) >= length)
+			return;
+
+		--length;
+		(std::get<TypeStorage<Owned>*>(storages)->swap(entity, std::get<TypeStorage<Owned>*>(storages)->keys()[length]), ...);
+	}
+
+	void exclude_all() override
+	{
+		length = 0;
+	}
+
+	//func(u64 entity, Owned&... components)
+	template<class Func>
+	void each(Func&& func)
+	{
+		const u64* entities = std::get<0>(storages)->keys();
+		std::tuple<Owned*...> arrays{ std::get<TypeStorage<Owned>*>(storages)->data()... };
+		for (u32 position = 0; position < length; position++) {
+			(std::get<TypeStorage<Owned>*>(storages)->mark_changed_at(position), ...);
+			func(entities[position], std::get<Owned*>(arrays)[position]...);
+		}
+	}
+
+	bool contains(u64 entity) const
+	{
+		return contains_all(entity) && std::get<0>(storages)->index_of(entity) < length;
+	}
+
+	u32 size() const { return length; }
+
+private:
+	bool contains_all(u64 entity) const
+	{
+		return (std::get<TypeStorage<Owned>*>(storages)->contains(entity) && ...);
+	}
+
+private:
+	Storages storages;
+	u32 length;
+};
+
+class Registry
+{
+public:
+	Registry() : Registry(default_resource()) {}
+
+	//Every storage, the entity slots and the frame arena are allocated from resource,
+	//unless set_resource picks another one for a component type
+	explicit Registry(MemoryResource& resource) : memory{ &resource }, frame_arena{ resource }, entities{ resource } {}
+
+	//Backs the storage of Type with resource, needs to be called before the storage exists
+	template<class Type>
+	void set_resource(MemoryResource& resource)
+	{
+		const u32 index = type_index<Type>();
+		assert(index >= type_register.size() || type_register[index] == nullptr);
+		if (index >= type_resources.size())
+			type_resources.resize(index + 1, nullptr);
+
+		type_resources[index] = &resource;
+	}
+
+	//Allocations of the storage of Type, which needs to exist
+	template<class Type>
+	MemoryStats memory_stats() const
+	{
+		return storage<Type>().memory_stats();
+	}
+
+	MemoryResource& resource() const
+	{
+		return *memory;
+	}
+
+	//Layout and allocations of the storage of Type, which needs to exist. Nothing is
+	//visited, it is cheap enough to be sampled every frame
+	template<class Type>
+	StorageStats storage_stats() const
+	{
+		return storage<Type>().storage_stats();
+	}
+
+	//Refills stats with every existing storage, reusing its memory
+	void storage_stats(std::vector<StorageStats>& stats) const
+	{
+		stats.clear();
+		for (const std::shared_ptr<GenericStorage>& storage : type_register) {
+			if (storage != nullptr)
+				stats.push_back(storage->storage_stats());
+		}
+	}
+
+	ContainerStats entity_stats() const
+	{
+		return entities.memory_usage();
+	}
+
+	//Writes the entity slots, the frame arena and every storage as a JSON object,
+	//false if the write failed
+	bool write_memory_json(std::FILE* file) const
+	{
+		std::fprintf(file, "{\n\t\"entities\": ");
+		write_json(file, entities.memory_usage());
+		std::fprintf(file, ",\n\t\"frame_arena\": { \"bytes_used\": %llu, \"bytes_reserved\": %llu },\n\t\"storages\": [",
+			static_cast<unsigned long long>(frame_arena.bytes_used()), static_cast<unsigned long long>(frame_arena.bytes_reserved()));
+
+		bool first = true;
+		for (const std::shared_ptr<GenericStorage>& storage : type_register) {
+			if (storage == nullptr)
+				continue;
+
+			const StorageStats stats = storage->storage_stats();
+			std::fprintf(file, "%s\n\t\t{ \"type\": \"", first ? "" : ",");
+			for (const char c : stats.name) {
+				if (c == '"' || c == '\\')
+					std::fputc('\\', file);
+				std::fputc(c, file);
+			}
+
+			std::fprintf(file, "\", \"hash\": \"%016llx\",\n\t\t  \"components\": ", static_cast<unsigned long long>(stats.hash_of_type));
+			write_json(file, stats.components);
+			std::fprintf(file, ",\n\t\t  \"ticks\": ");
+			write_json(file, stats.ticks);
+			const MemoryStats& allocations = stats.allocations;
+			std::fprintf(file, ",\n\t\t  \"allocations\": { \"count\": %llu, \"frees\": %llu, \"bytes_allocated\": %llu, \"bytes_live\": %llu, \"bytes_peak\": %llu } }",
+				static_cast<unsigned long long>(allocations.allocations), static_cast<unsigned long long>(allocations.deallocations),
+				static_cast<unsigned long long>(allocations.bytes_allocated), static_cast<unsigned long long>(allocations.bytes_live),
+				static_cast<unsigned long long>(allocations.bytes_peak));
+			first = false;
+		}
+
+		std::fprintf(file, "%s]\n}\n", first ? "" : "\n\t");
+		return std::ferror(file) == 0;
+	}
+
+	template <class Type, class... Args>
+	decltype(auto) add_component(u64 entity, Args&&... args) noexcept 
+	{
+		static_assert(!std::is_same_v<Type, void>, "void allocation not possible");
+		assert(entities.valid(entity));
+		
+		TypeStorage<Type>& storage_of_type = assure<Type>();
+		storage_of_type.emplace(entity, std::forward<Args>(args)...);
+		if (GroupBase* group = owner(type_index<Type>()))
+			group->include(entity);
+
+		return storage_of_type[entity];
+	}
+
+	//Gives a copy of the same component to every entity in [first, last), the
+	//entities need to be sorted like the ones returned by create_entity
+	template <class Type, class EntityIt, class... Args>
+	void add_components(EntityIt first, EntityIt last, const Args&... args)
+	{
+		static_assert(!std::is_same_v<Type, void>, "void allocation not possible");
+		assure<Type>().emplace_sorted(first, last, args...);
+		if (GroupBase* group = owner(type_index<Type>())) {
+			for (; first != last; ++first)
+				group->include(*first);
+		}
+	}
+
+	//Same requirements as add_components, entity first[i] takes the value moved out of values[i]
+	template <class Type, class EntityIt, class ValueIt>
+	void insert_components(EntityIt first, EntityIt last, ValueIt values)
+	{
+		static_assert(!std::is_same_v<Type, void>, "void allocation not possible");
+		assure<Type>().insert_sorted(first, last, values);
+		if (GroupBase* group = owner(type_index<Type>())) {
+			for (; first != last; ++first)
+				group->include(*first);
+		}
+	}
+
+	template<class Type>
+	[[nodiscard]] bool has_component(u64 entity) const
+	{
+		const u32 index = type_index<Type>();
+		return index < type_register.size() && type_register[index] != nullptr && type_register[index]->contains(entity);
+	}
+
+	//Read only and tick free, so systems reading the same type can run concurrently.
+	//Writes go through patch, which marks the component for Changed filters and deltas
+	template<class Type>
+	[[nodiscard]] decltype(auto) get_component(u64 entity) const
+	{
+		const TypeStorage<Type>& storage_of_type = storage<Type>();
+		assert(storage_of_type.contains(entity));
+
+		return storage_of_type[entity];
+	}
+
+	//Mutable access to a component, marked changed at the current tick
+	template<class Type>
+	[[nodiscard]] decltype(auto) patch(u64 entity)
+	{
+		TypeStorage<Type>& storage_of_type = storage<Type>();
+		assert(storage_of_type.contains(entity));
+
+		return storage_of_type.patch(entity);
+	}
+
+	template<class Type, class... Args>
+	[[nodiscard]] decltype(auto) replace_component(u64 entity, Args&&... args)
+	{
+		TypeStorage<Type>& storage_of_type = storage<Type>();
+		assert(storage_of_type.contains(entity));
+
+		GroupBase* group = owner(type_index<Type>());
+		if (group != nullptr)
+			group->exclude(entity);
+
+		storage_of_type.emplace_or_replace(entity, std::forward<Args>(args)...);
+		if (group != nullptr)
+			group->include(entity);
+
+		return storage_of_type[entity];
+	}
+
+	template<class Type>
+	void delete_component(u64 entity)
+	{
+		TypeStorage<Type>& storage_of_type = storage<Type>();
+		auto attribute_to_delete = storage_of_type.find(entity);
+		assert(attribute_to_delete != storage_of_type.end());
+
+		if (GroupBase* group = owner(type_index<Type>())) {
+			group->exclude(entity);
+			attribute_to_delete = storage_of_type.find(entity);
+		}
+
+		storage_of_type.destroy(attribute_to_delete);
+		if (checkpointed)
+			storage_of_type.removed.push_back(entity);
+	}
+
+	//Every entity in [first, last) needs to own the component, sorted like the ones returned by create_entity
+	template<class Type, class EntityIt>
+	void delete_components(EntityIt first, EntityIt last)
+	{
+		TypeStorage<Type>& storage_of_type = storage<Type>();
+		if (GroupBase* group = owner(type_index<Type>())) {
+			for (EntityIt it = first; it != last; ++it)
+				group->exclude(*it);
+		}
+
+		storage_of_type.destroy_sorted(first, last);
+		if (checkpointed)
+			storage_of_type.removed.insert(storage_of_type.removed.end(), first, last);
+	}
+
+	//Removes the component from every entity
+	template<class Type>
+	void clear_components()
+	{
+		if (GroupBase* group = owner(type_index<Type>()))
+			group->exclude_all();
+
+		TypeStorage<Type>& storage_of_type = assure<Type>();
+		storage_of_type.clear();
+		if (checkpointed) {
+			storage_of_type.removed.clear();
+			storage_of_type.cleared = true;
+		}
+	}
+
+	//Creates the storages of Types ahead of time, required before accessing them from several threads
+	template<class... Types>
+	void register_components()
+	{
+		(assure<Types>(), ...);
+	}
+
+	//Iterate every entity owning all of Types, storages that do not exist yet are created empty.
+	//filters are Changed<T> or Added<T> instances, e.g. view<Position>(Changed<Position>{ last_tick })
+	template<class... Types, class... Filters>
+	[[nodiscard]] View<Types...> view(Filters... filters)
+	{
+		View<Types...> result{ assure<std::remove_const_t<Types>>()... };
+		(result.add_filter(tick_filter(filters)), ...);
+		return result;
+	}
+
+	//Every add and mutable access stamps the component with the current tick
+	u32 tick() const
+	{
+		return current_tick;
+	}
+
+	u32 advance_tick()
+	{
+		return ++current_tick;
+	}
+
+	//Drops every component stored in a TransientSet and gives the frame arena back in one go.
+	//Scheduler::run calls it once the systems of the frame are done, before the commands are
+	//applied, so a transient component added by a command is seen by the systems of one frame
+	void end_frame()
+	{
+		for (u32 index : transient_types) {
+			GenericStorage& storage = *type_register[index];
+			storage.clear();
+			if (checkpointed) {
+				storage.removed.clear();
+				storage.cleared = true;
+			}
+		}
+
+		frame_arena.reset();
+	}
+
+	//Owning group of Types, created on first use from the components already present.
+	//Asking again for the same Types returns the same group
+	template<class... Types>
+	Group<Types...>& group()
+	{
+		using GroupType = Group<Types...>;
+		const u32 indices[] = { type_index<Types>()... };
+		if (GroupBase* existing = owner(indices[0])) {
+			assert(existing->hash_of_group == type_hash<GroupType>());
+			return static_cast<GroupType&>(*existing);
+		}
+
+		groups.push_back(std::make_unique<GroupType>(assure<Types>()...));
+		for (u32 index : indices) {
+			assert(owner(index) == nullptr);
+			if (index >= owners.size())
+				owners.resize(index + 1, nullptr);
+
+			owners[index] = groups.back().get();
+		}
+
+		return static_cast<GroupType&>(*groups.back());
+	}
+
+	u64 create_entity()
+	{
+		const u64 entity = entities.create();
+		if (checkpointed)
+			touched_slots.push_back(entity_index(entity));
+
+		return entity;
+	}
+
+	//Same as create_entity but safe from several threads at once, e.g. in a parallel system.
+	//Destroyed slots are not reused until reclaim_entities, which a CommandQueue flush runs
+	u64 create_entity_concurrent()
+	{
+		return entities.create_concurrent();
+	}
+
+	//Gives the slots reserved but not used by create_entity_concurrent back to the pool,
+	//no thread may be creating entities meanwhile
+	void reclaim_entities()
+	{
+		entities.reclaim([&](u32 first, u32 last) {
+			if (checkpointed) {
+				for (u32 index = first; index < last; index++)
+					touched_slots.push_back(index);
+			}
+		});
+	}
+
+	//Removes every component of the entity, its slot is recycled by a later
+	//create_entity with a new generation so this handle stays invalid
+	void destroy_entity(u64 entity)
+	{
+		assert(entities.valid(entity));
+		for (u32 index = 0; index < type_register.size(); index++) {
+			const std::shared_ptr<GenericStorage>& storage = type_register[index];
+			if (storage == nullptr || !storage->contains(entity))
+				continue;
+
+			if (GroupBase* group = owner(index))
+				group->exclude(entity);
+
+			storage->destroy(entity);
+		}
+
+		entities.destroy(entity);
+		if (checkpointed)
+			touched_slots.push_back(entity_index(entity));
+	}
+
+	//Same as destroy_entity on every entity in [first, last), in any order and with repeats.
+	//Each storage drops its components in one bulk erase
+	template<class EntityIt>
+	void destroy_entities(EntityIt first, EntityIt last)
+	{
+		std::vector<u64> sorted(first, last);
+		std::sort(sorted.begin(), sorted.end());
+		sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+		//Checked before any storage is touched
+		for (u64 entity : sorted)
+			assert(entities.valid(entity));
+
+		for (u32 index = 0; index < type_register.size(); index++) {
+			const std::shared_ptr<GenericStorage>& storage = type_register[index];
+			if (storage == nullptr)
+				continue;
+
+			if (GroupBase* group = owner(index)) {
+				for (u64 entity : sorted)
+					group->exclude(entity);
+			}
+
+			storage->destroy_sorted(sorted.data(), sorted.data() + sorted.size());
+		}
+
+		for (u64 entity : sorted) {
+			entities.destroy(entity);
+			if (checkpointed)
+				touched_slots.push_back(entity_index(entity));
+		}
+	}
+
+	bool valid(u64 entity) const
+	{
+		return entities.valid(entity);
+	}
+
+	u32 entity_count() const
+	{
+		return entities.size();
+	}
+
+	//Writes the entities, the tick and every storage of trivially copyable components,
+	//the other storages are left out. The snapshot becomes the checkpoint save_delta
+	//starts from. False if the file could not be written
+	bool save_snapshot(const char* path)
+	{
+		reclaim_entities();
+		SnapshotWriter writer{ path };
+		SnapshotHeader header{};
+		header.magic = SNAPSHOT_MAGIC;
+		header.version = SNAPSHOT_VERSION;
+		header.tick = current_tick;
+		header.slot_count = entities.slot_count();
+		header.free_head = entities.free_slot();
+		header.alive = entities.size();
+		header.slots = writer.align();
+		entities.for_each_segment([&](const u64* slots, u32 count) { writer.append(slots, count); });
+
+		std::vector<SnapshotStorage> directory;
+		for (const std::shared_ptr<GenericStorage>& storage : type_register) {
+			SnapshotStorage entry{};
+			if (storage != nullptr && storage->save(writer, entry))
+				directory.push_back(entry);
+		}
+
+		header.storage_count = static_cast<u32>(directory.size());
+		header.directory = writer.write(directory.data(), header.storage_count);
+		if (!writer.finish(header))
+			return false;
+
+		checkpoint();
+		return true;
+	}
+
+	//Fills a registry without entities and groups from a file written by save_snapshot in the
+	//same build. The storages of every saved type need to exist, see register_components.
+	//The file is mapped and SparseSet storages use their part of it in place, so loading
+	//costs no per component work besides indexing. False if the file is missing, corrupt
+	//or holds a type without storage, the registry is left untouched then. The snapshot
+	//becomes the checkpoint the deltas given to load_deltas have to start from
+	bool load_snapshot(const char* path)
+	{
+		assert(entities.size() == 0 && groups.empty());
+		std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>();
+		if (!file->open(path) || file->size() < sizeof(SnapshotHeader))
+			return false;
+
+		const SnapshotHeader& header = *file->at<SnapshotHeader>(0);
+		if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+			header.alive > header.slot_count || (header.free_head != EntityPool::NO_SLOT && header.free_head >= header.slot_count) ||
+			!file->holds(header.slots, header.slot_count, sizeof(u64)) ||
+			!file->holds(header.directory, header.storage_count, sizeof(SnapshotStorage)))
+			return false;
+
+		const SnapshotStorage* directory = file->at<SnapshotStorage>(header.directory);
+		std::vector<GenericStorage*> targets(header.storage_count);
+		for (u32 i = 0; i < header.storage_count; i++) {
+			const SnapshotStorage& entry = directory[i];
+			targets[i] = storage_of_hash(entry.type_hash);
+			if (targets[i] == nullptr || std::find(targets.begin(), targets.begin() + i, targets[i]) != targets.begin() + i ||
+				entry.value_size == 0 || targets[i]->snapshot_value_size() != entry.value_size ||
+				!file->holds(entry.keys, entry.count, sizeof(u64)) ||
+				!file->holds(entry.values, entry.count, entry.value_size) ||
+				!file->holds(entry.tick_keys, entry.count, sizeof(u64)) ||
+				!file->holds(entry.ticks, entry.count, sizeof(ComponentTicks)))
+				return false;
+		}
+
+		entities.restore(file->at<u64>(header.slots), header.slot_count, header.free_head, header.alive);
+		for (u32 i = 0; i < header.storage_count; i++)
+			targets[i]->load(*file, directory[i]);
+
+		current_tick = header.tick;
+		snapshots.push_back(std::move(file));
+		checkpoint();
+		return true;
+	}
+
+	//Writes the entities and components created, changed or removed since the last checkpoint
+	//to descriptor, with the same storages as save_snapshot, and makes this the new checkpoint.
+	//Only a few records are buffered at a time. False if writing failed, the checkpoint stays
+	//where it was then
+	bool save_delta(int descriptor)
+	{
+		assert(checkpointed);
+		reclaim_entities();
+		DeltaWriter writer{ descriptor };
+		const DeltaHeader header{ DELTA_MAGIC, DELTA_VERSION, checkpoint_tick, current_tick,
+			entities.slot_count(), entities.free_slot(), entities.size(), 0 };
+		writer.write(&header, 1);
+
+		std::sort(touched_slots.begin(), touched_slots.end());
+		touched_slots.erase(std::unique(touched_slots.begin(), touched_slots.end()), touched_slots.end());
+		std::vector<u64> slots;
+		for (size_t first = 0; first < touched_slots.size(); first += DELTA_CHUNK) {
+			const u32 count = static_cast<u32>(std::min<size_t>(DELTA_CHUNK, touched_slots.size() - first));
+			slots.clear();
+			for (u32 i = 0; i < count; i++)
+				slots.push_back(entities.slot(touched_slots[first + i]));
+
+			const DeltaRecord record{ DeltaKind::Slots, count, 0, 0, 0 };
+			writer.write(&record, 1);
+			writer.write(touched_slots.data() + first, count);
+			writer.write(slots.data(), count);
+		}
+
+		for (const std::shared_ptr<GenericStorage>& storage : type_register) {
+			if (storage == nullptr || storage->snapshot_value_size() == 0)
+				continue;
+
+			if (storage->cleared) {
+				const DeltaRecord record{ DeltaKind::Clear, 0, storage->hash_of_type, 0, 0 };
+				writer.write(&record, 1);
+			}
+
+			std::vector<u64>& removed = storage->removed;
+			std::sort(removed.begin(), removed.end());
+			removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+			for (size_t first = 0; first < removed.size(); first += DELTA_CHUNK) {
+				const u32 count = static_cast<u32>(std::min<size_t>(DELTA_CHUNK, removed.size() - first));
+				const DeltaRecord record{ DeltaKind::Removals, count, storage->hash_of_type, 0, 0 };
+				writer.write(&record, 1);
+				writer.write(removed.data() + first, count);
+			}
+
+			storage->save_delta(writer, checkpoint_tick);
+		}
+
+		const DeltaRecord end{ DeltaKind::End, 0, 0, 0, 0 };
+		writer.write(&end, 1);
+		if (!writer.flush())
+			return false;
+
+		checkpoint();
+		return true;
+	}
+
+	//Applies every delta read from descriptor until the end of the stream, e.g. a file the
+	//deltas were appended to. Each one has to start at the checkpoint the previous one, or the
+	//loaded snapshot, ended at. The registry may not have groups. False if the stream is corrupt,
+	//does not continue the chain or holds a type without storage, the registry can be
+	//partially updated then
+	bool load_deltas(int descriptor)
+	{
+		assert(checkpointed && groups.empty());
+		DeltaReader reader{ descriptor };
+		while (!reader.at_end()) {
+			DeltaHeader header{};
+			if (!reader.read(&header, 1) || header.magic != DELTA_MAGIC || header.version != DELTA_VERSION ||
+				header.since != checkpoint_tick || header.slot_count < entities.slot_count() || header.alive > header.slot_count ||
+				(header.free_head != EntityPool::NO_SLOT && header.free_head >= header.slot_count))
+				return false;
+
+			//Entities whose slot changed lose their components before the storages are updated
+			const u32 previous_count = entities.slot_count();
+			entities.restore_state(header.slot_count, header.free_head, header.alive);
+			std::vector<u64> destroyed;
+			bool slots_done = false;
+			auto finish_slots = [&]() {
+				if (slots_done)
+					return;
+
+				std::sort(destroyed.begin(), destroyed.end());
+				for (const std::shared_ptr<GenericStorage>& storage : type_register) {
+					if (storage != nullptr)
+						storage->destroy_sorted(destroyed.data(), destroyed.data() + destroyed.size());
+				}
+
+				slots_done = true;
+			};
+
+			DeltaRecord record{};
+			while (true) {
+				if (!reader.read(&record, 1) || record.count > DELTA_CHUNK)
+					return false;
+
+				if (record.kind == DeltaKind::End)
+					break;
+
+				if (record.kind == DeltaKind::Slots) {
+					std::vector<u32> indices(record.count);
+					std::vector<u64> slots(record.count);
+					if (slots_done || !reader.read(indices.data(), record.count) || !reader.read(slots.data(), record.count))
+						return false;
+
+					for (u32 i = 0; i < record.count; i++) {
+						if (indices[i] >= header.slot_count)
+							return false;
+
+						const u64 previous = indices[i] < previous_count ? entities.slot(indices[i]) : NULL_ENTITY;
+						if (previous != NULL_ENTITY && entities.valid(previous) && previous != slots[i])
+							destroyed.push_back(previous);
+
+						entities.restore_slot(indices[i], slots[i]);
+					}
+
+					continue;
+				}
+
+				finish_slots();
+				GenericStorage* storage = storage_of_hash(record.type_hash);
+				if (storage == nullptr)
+					return false;
+
+				if (record.kind == DeltaKind::Clear) {
+					storage->clear();
+				}
+				else if (record.kind == DeltaKind::Removals) {
+					std::vector<u64> removed(record.count);
+					if (!reader.read(removed.data(), record.count))
+						return false;
+
+					storage->destroy_sorted(removed.data(), removed.data() + removed.size());
+				}
+				else if (record.kind != DeltaKind::Components || !storage->load_delta(reader, record)) {
+					return false;
+				}
+			}
+
+			finish_slots();
+			current_tick = header.tick;
+			checkpoint();
+		}
+
+		return true;
+	}
+private:
+	template<class Type>
+	TypeStorage<Type>& assure()
+	{
+		const u32 index = type_index<Type>();
+		if (index >= type_register.size())
+			type_register.resize(index + 1);
+
+		if (type_register[index] == nullptr) {
+			MemoryResource* resource = index < type_resources.size() && type_resources[index] != nullptr ? type_resources[index] : memory;
+			type_register[index] = std::make_shared<TypeStorage<Type>>(current_tick, frame_arena, *resource);
+			if constexpr (is_transient_set<typename StorageTraits<Type>::MapType>::value)
+				transient_types.push_back(index);
+		}
+
+		return storage_cast<Type>(type_register[index]);
+	}
+
+	//The storage of Type needs to exist already
+	template<class Type>
+	TypeStorage<Type>& storage() const
+	{
+		const u32 index = type_index<Type>();
+		assert(index < type_register.size() && type_register[index] != nullptr);
+		return storage_cast<Type>(type_register[index]);
+	}
+
+	template<class Type>
+	TickFilter tick_filter(Changed<Type> filter)
+	{
+		return assure<Type>().tick_filter(filter.since, false);
+	}
+
+	template<class Type>
+	TickFilter tick_filter(Added<Type> filter)
+	{
+		return assure<Type>().tick_filter(filter.since, true);
+	}
+
+	GenericStorage* storage_of_hash(u64 hash) const
+	{
+		for (const std::shared_ptr<GenericStorage>& storage : type_register) {
+			if (storage != nullptr && storage->hash_of_type == hash)
+				return storage.get();
+		}
+
+		return nullptr;
+	}
+
+	//Closes the current tick, the next delta holds what changes after it
+	void checkpoint()
+	{
+		checkpoint_tick = current_tick++;
+		checkpointed = true;
+		touched_slots.clear();
+		for (const std::shared_ptr<GenericStorage>& storage : type_register) {
+			if (storage != nullptr) {
+				storage->removed.clear();
+				storage->cleared = false;
+			}
+		}
+	}
+
+	//fragmentation is the share of the slots allocated but unused
+	static void write_json(std::FILE* file, const ContainerStats& stats)
+	{
+		const double fragmentation = stats.capacity != 0 ? static_cast<double>(stats.capacity - stats.size) / stats.capacity : 0.0;
+		std::fprintf(file, "{ \"size\": %llu, \"capacity\": %llu, \"node_bytes\": %llu, \"payload_bytes\": %llu, \"fragmentation\": %.4f, \"height\": %u }",
+			static_cast<unsigned long long>(stats.size), static_cast<unsigned long long>(stats.capacity),
+			static_cast<unsigned long long>(stats.node_bytes), static_cast<unsigned long long>(stats.payload_bytes), fragmentation, stats.height);
+	}
+
+	GroupBase* owner(u32 index) const
+	{
+		return index < owners.size() ? owners[index] : nullptr;
+	}
+
+	//Mapped files adopted by the storages, declared first so they outlive them.
+	//Storages emptied since may still point into earlier ones, so none is unmapped
+	std::vector<std::unique_ptr<MappedFile>> snapshots;
+	MemoryResource* memory;
+	//Backs the TransientSet storages, declared before them for the same reason
+	MonotonicArena frame_arena;
+	EntityPool entities;
+	//Indexed by type_index
+	std::vector<std::shared_ptr<GenericStorage>> type_register;
+	//Indices of the storages backed by a TransientSet
+	std::vector<u32> transient_types;
+	//Resources picked by set_resource, indexed by type_index
+	std::vector<MemoryResource*> type_resources;
+	//Group owning the storage at the same index, if any
+	std::vector<GroupBase*> owners;
+	std::vector<std::unique_ptr<GroupBase>> groups;
+	//Starts at 1 so Changed<T>{ 0 } matches every component
+	u32 current_tick = 1;
+	//Tick closed by the last snapshot or delta, what happened since is logged only once there is one
+	u32 checkpoint_tick = 0;
+	bool checkpointed = false;
+	//Slots of the entities created or destroyed since the checkpoint
+	std::vector<u32> touched_slots;
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include "registry.h"
+#include "command_buffer.h"
+#include "thread_pool.h"
+
+//Component access declarations of a system, e.g. add_system<Read<Velocity>, Write<Position>>
+//Read types are accessed with get_component or listed const in views, which leave their ticks
+//alone, Write types may be changed through patch or non const views
+template<class... Types>
+struct Read
+{
+	static void append(std::vector<u32>& indices) { (indices.push_back(type_index<Types>()), ...); }
+	static void register_in(Registry& registry) { registry.register_components<Types...>(); }
+};
+
+template<class... Types>
+struct Write
+{
+	static void append(std::vector<u32>& indices) { (indices.push_back(type_index<Types>()), ...); }
+	static void register_in(Registry& registry) { registry.register_components<Types...>(); }
+};
+
+//Runs the registered systems once per frame. A system depends on every system
+//registered before it that writes a type it accesses or reads a type it writes,
+//systems without a path between them in this graph run concurrently on the pool.
+//Systems may only touch the components they declared, structural changes go through
+//commands() and are applied once every system of the frame has finished and the transient
+//components have been dropped, the registry tick is advanced after that so Changed/Added
+//filters can compare against the last frame
+class Scheduler
+{
+	struct System
+	{
+		std::function<void(Registry&)> function;
+		std::vector<u32> reads, writes;
+		std::vector<u32> dependents;
+		u32 dependency_count;
+		std::atomic<u32> remaining_dependencies;
+	};
+
+public:
+	Scheduler(Registry& registry, ThreadPool& pool) : registry{registry}, pool{pool}, command_queue{registry}, graph_dirty{false} {}
+
+	template<class Reads, class Writes, class Func>
+	void add_system(Func&& func)
+	{
+		auto system = std::make_unique<System>();
+		system->function = std::forward<Func>(func);
+		Reads::append(system->reads);
+		Writes::append(system->writes);
+
+		//Systems run concurrently, the storages need to exist before
+		Reads::register_in(registry);
+		Writes::register_in(registry);
+
+		systems.push_back(std::move(system));
+		graph_dirty = true;
+	}
+
+	void run()
+	{
+		if (graph_dirty)
+			build_graph();
+
+		std::atomic<u32> remaining{0};
+		for (const std::unique_ptr<System>& system : systems)
+			system->remaining_dependencies.store(system->dependency_count, std::memory_order_relaxed);
+
+		for (u32 index = 0; index < systems.size(); index++) {
+			if (systems[index]->dependency_count == 0)
+				pool.submit([this, index, &remaining]() { run_system(index, remaining); }, remaining);
+		}
+
+		pool.wait(remaining);
+		registry.end_frame();
+		command_queue.flush();
+		registry.advance_tick();
+	}
+
+	//Systems record into commands().local() from whichever thread runs them
+	CommandQueue& commands()
+	{
+		return command_queue;
+	}
+
+private:
+	void run_system(u32 index, std::atomic<u32>& remaining)
+	{
+		System& system = *systems[index];
+		system.function(registry);
+
+		//Submitted before this task completes so remaining never drops to zero early
+		for (u32 dependent : system.dependents) {
+			if (systems[dependent]->remaining_dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				pool.submit([this, dependent, &remaining]() { run_system(dependent, remaining); }, remaining);
+		}
+	}
+
+	void build_graph()
+	{
+		for (const std::unique_ptr<System>& system : systems) {
+			system->dependents.clear();
+			system->dependency_count = 0;
+		}
+
+		for (u32 later = 0; later < systems.size(); later++) {
+			for (u32 earlier = 0; earlier < later; earlier++) {
+				if (conflicts(*systems[earlier], *systems[later])) {
+					systems[earlier]->dependents.push_back(later);
+					++systems[later]->dependency_count;
+				}
+			}
+		}
+
+		graph_dirty = false;
+	}
+
+	static bool conflicts(const System& first, const System& second)
+	{
+		return intersects(first.writes, second.writes) ||
+			intersects(first.writes, second.reads) ||
+			intersects(first.reads, second.writes);
+	}
+
+	static bool intersects(const std::vector<u32>& first, const std::vector<u32>& second)
+	{
+		for (u32 index : first) {
+			if (std::find(second.begin(), second.end(), index) != second.end())
+				return true;
+		}
+
+		return false;
+	}
+
+private:
+	Registry& registry;
+	ThreadPool& pool;
+	CommandQueue command_queue;
+	std::vector<std::unique_ptr<System>> systems;
+	bool graph_dirty;
+};
@@ -0,0 +1,361 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <type_traits>
+#include "types.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//Binary snapshot of a Registry, in the byte order of the machine that wrote it:
+//  SnapshotHeader | entity slots | per storage: keys, values, tick keys, ticks | directory
+//Every array starts at a SNAPSHOT_ALIGN boundary so a mapped file can be used in place.
+//Storages are matched by type_hash, which is only stable within the same build
+constexpr u32 SNAPSHOT_MAGIC        = 0x53534345; //"ECSS"
+constexpr u32 SNAPSHOT_VERSION      = 1;
+constexpr u32 SNAPSHOT_ALIGN        = 64;
+
+struct SnapshotHeader
+{
+	u32 magic;
+	u32 version;
+	u32 tick;
+	u32 storage_count;
+	//EntityPool state
+	u32 slot_count;
+	u32 free_head;
+	u32 alive;
+	u32 padding;
+	//File offsets of the entity slots and of the storage_count SnapshotStorage entries
+	u64 slots;
+	u64 directory;
+};
+
+//One TypeStorage, the offsets point at count elements each
+struct SnapshotStorage
+{
+	u64 type_hash;
+	u32 count;
+	u32 value_size;
+	u64 keys;
+	u64 values;
+	u64 tick_keys;
+	u64 ticks;
+};
+
+//Appends aligned arrays to a file, the header is written last once every offset is known
+class SnapshotWriter
+{
+public:
+	explicit SnapshotWriter(const char* path) : file{ std::fopen(path, "wb") }
+	{
+		failed = file == nullptr;
+		SnapshotHeader header{};
+		write_bytes(&header, sizeof(header));
+	}
+
+	SnapshotWriter(const SnapshotWriter&) = delete;
+	SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+	~SnapshotWriter()
+	{
+		if (file != nullptr)
+			std::fclose(file);
+	}
+
+	//Returns the offset of the first element
+	template<typename Type>
+	u64 write(const Type* data, u32 count)
+	{
+		const u64 position = align();
+		append(data, count);
+		return position;
+	}
+
+	//Pads to the next SNAPSHOT_ALIGN boundary and returns it, for arrays written in several appends
+	u64 align()
+	{
+		static const u8 zeros[SNAPSHOT_ALIGN]{};
+		write_bytes(zeros, (SNAPSHOT_ALIGN - offset % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN);
+		return offset;
+	}
+
+	//Continues the array of the previous write without padding
+	template<typename Type>
+	void append(const Type* data, u32 count)
+	{
+		static_assert(std::is_trivially_copyable_v<Type>, "only trivially copyable data can be written");
+		write_bytes(data, sizeof(Type) * count);
+	}
+
+	//False if any write failed
+	bool finish(const SnapshotHeader& header)
+	{
+		if (failed || std::fseek(file, 0, SEEK_SET) != 0)
+			return false;
+
+		write_bytes(&header, sizeof(header));
+		const bool closed = std::fclose(file) == 0;
+		file = nullptr;
+		return closed && !failed;
+	}
+
+private:
+	void write_bytes(const void* data, u64 bytes)
+	{
+		if (failed || bytes == 0)
+			return;
+
+		failed = std::fwrite(data, 1, bytes, file) != bytes;
+		offset += bytes;
+	}
+
+private:
+	std::FILE* file;
+	u64 offset = 0;
+	bool failed;
+};
+
+//Private copy-on-write mapping of a whole file: the pages are only read from disk when
+//touched and writing through data() never reaches the file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+#if defined(_WIN32)
+		if (bytes != nullptr)
+			UnmapViewOfFile(bytes);
+#else
+		if (bytes != nullptr)
+			munmap(bytes, length);
+#endif
+	}
+
+	bool open(const char* path)
+	{
+		assert(bytes == nullptr);
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER file_size{};
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+			mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+
+		if (mapping != nullptr) {
+			bytes = static_cast<u8*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+
+		CloseHandle(file);
+		length = bytes != nullptr ? static_cast<u64>(file_size.QuadPart) : 0;
+#else
+		const int file = ::open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat status{};
+		if (fstat(file, &status) == 0 && status.st_size > 0) {
+			void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			if (view != MAP_FAILED) {
+				bytes = static_cast<u8*>(view);
+				length = static_cast<u64>(status.st_size);
+			}
+		}
+
+		::close(file);
+#endif
+		return bytes != nullptr;
+	}
+
+	//True if count elements of element_size bytes fit at offset, which needs to be SNAPSHOT_ALIGN aligned
+	bool holds(u64 offset, u64 count, u64 element_size) const
+	{
+		return offset % SNAPSHOT_ALIGN == 0 && offset <= length && count * element_size <= length - offset;
+	}
+
+	template<typename Type>
+	Type* at(u64 offset) const
+	{
+		return reinterpret_cast<Type*>(bytes + offset);
+	}
+
+	u8* data() const { return bytes; }
+	u64 size() const { return length; }
+
+private:
+	u8* bytes = nullptr;
+	u64 length = 0;
+};
+
+//Delta snapshot, a stream of records following one DeltaHeader:
+//  Slots: count u32 slot indices, then their count u64 EntityPool slots
+//  Clear: the storage of type_hash loses every component
+//  Removals: count sorted u64 entities losing the component
+//  Components: count u64 entities, count values and count ComponentTicks, added or replaced
+//  End: closes the delta, another one may follow in the same stream
+//Records hold at most DELTA_CHUNK elements so neither side buffers a whole delta
+constexpr u32 DELTA_MAGIC           = 0x44534345; //"ECSD"
+constexpr u32 DELTA_VERSION         = 1;
+constexpr u32 DELTA_CHUNK           = 4096;
+
+enum class DeltaKind : u32 { Slots = 0, Clear, Removals, Components, End };
+
+struct DeltaHeader
+{
+	u32 magic;
+	u32 version;
+	//Tick of the checkpoint the delta starts from and of the one it ends at
+	u32 since;
+	u32 tick;
+	//EntityPool state at the end of the delta
+	u32 slot_count;
+	u32 free_head;
+	u32 alive;
+	u32 padding;
+};
+
+struct DeltaRecord
+{
+	DeltaKind kind;
+	u32 count;
+	u64 type_hash;
+	u32 value_size;
+	u32 padding;
+};
+
+//Buffered sequential writes to a file descriptor, pipes and sockets included
+class DeltaWriter
+{
+public:
+	explicit DeltaWriter(int descriptor) : descriptor{ descriptor } {}
+	DeltaWriter(const DeltaWriter&) = delete;
+	DeltaWriter& operator=(const DeltaWriter&) = delete;
+
+	template<typename Type>
+	void write(const Type* data, u32 count)
+	{
+		static_assert(std::is_trivially_copyable_v<Type>, "only trivially copyable data can be written");
+		const u8* bytes = reinterpret_cast<const u8*>(data);
+		u64 remaining = sizeof(Type) * static_cast<u64>(count);
+		while (remaining != 0 && !failed) {
+			const u64 step = remaining < BUFFER_SIZE - used ? remaining : BUFFER_SIZE - used;
+			std::memcpy(buffer + used, bytes, step);
+			used += static_cast<u32>(step);
+			bytes += step;
+			remaining -= step;
+			if (used == BUFFER_SIZE)
+				flush();
+		}
+	}
+
+	//False if any write failed
+	bool flush()
+	{
+		u32 written = 0;
+		while (written < used && !failed) {
+#if defined(_WIN32)
+			const int result = _write(descriptor, buffer + written, used - written);
+#else
+			const ssize_t result = ::write(descriptor, buffer + written, used - written);
+			if (result < 0 && errno == EINTR)
+				continue;
+#endif
+			failed = result <= 0;
+			written += failed ? 0 : static_cast<u32>(result);
+		}
+
+		used = 0;
+		return !failed;
+	}
+
+private:
+	static constexpr u32 BUFFER_SIZE    = 1 << 16;
+
+	int descriptor;
+	u8 buffer[BUFFER_SIZE];
+	u32 used = 0;
+	bool failed = false;
+};
+
+//Buffered sequential reads from a file descriptor
+class DeltaReader
+{
+public:
+	explicit DeltaReader(int descriptor) : descriptor{ descriptor } {}
+	DeltaReader(const DeltaReader&) = delete;
+	DeltaReader& operator=(const DeltaReader&) = delete;
+
+	//False if the stream ended or failed before count elements were read
+	template<typename Type>
+	bool read(Type* data, u32 count)
+	{
+		static_assert(std::is_trivially_copyable_v<Type>, "only trivially copyable data can be read");
+		u8* bytes = reinterpret_cast<u8*>(data);
+		u64 remaining = sizeof(Type) * static_cast<u64>(count);
+		while (remaining != 0) {
+			if (position == used && !fill())
+				return false;
+
+			const u64 step = remaining < used - position ? remaining : used - position;
+			std::memcpy(bytes, buffer + position, step);
+			position += static_cast<u32>(step);
+			bytes += step;
+			remaining -= step;
+		}
+
+		return true;
+	}
+
+	//True once every byte has been consumed and the descriptor reports the end of the stream
+	bool at_end()
+	{
+		return position == used && !fill() && !failed;
+	}
+
+private:
+	bool fill()
+	{
+		position = used = 0;
+		while (!failed) {
+#if defined(_WIN32)
+			const int result = _read(descriptor, buffer, BUFFER_SIZE);
+#else
+			const ssize_t result = ::read(descriptor, buffer, BUFFER_SIZE);
+			if (result < 0 && errno == EINTR)
+				continue;
+#endif
+			failed = result < 0;
+			used = result > 0 ? static_cast<u32>(result) : 0;
+			break;
+		}
+
+		return used != 0;
+	}
+
+private:
+	static constexpr u32 BUFFER_SIZE    = 1 << 16;
+
+	int descriptor;
+	u8 buffer[BUFFER_SIZE];
+	u32 position = 0, used = 0;
+	bool failed = false;
+};
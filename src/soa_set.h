@@ -0,0 +1,424 @@
+#pragma once
+#include <new>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <cstring>
+#include "types.h"
+#include "entity.h"
+#include "sparse_set.h"
+
+//Specialize for a component stored in a SoaSet, listing every member that has to be kept:
+//  template<> struct SoaFields<Vector2D> { static constexpr auto members = std::make_tuple(&Vector2D::x, &Vector2D::y); };
+template<typename Type>
+struct SoaFields;
+
+template<typename Member>
+struct member_type;
+
+template<typename Class, typename Field>
+struct member_type<Field Class::*>
+{
+	using type = Field;
+};
+
+//Contiguous, aligned run of one field of every element, usable in SIMD loops
+template<typename Field>
+struct FieldColumn
+{
+	Field* data;
+	u32 count;
+
+	Field* begin() const { return data; }
+	Field* end() const { return data + count; }
+	Field& operator[](u32 position) const { return data[position]; }
+	u32 size() const { return count; }
+};
+
+template<typename Type, typename = std::make_index_sequence<std::tuple_size_v<decltype(SoaFields<Type>::members)>>>
+struct SoaLayout;
+
+template<typename Type, size_t... I>
+struct SoaLayout<Type, std::index_sequence<I...>>
+{
+	static constexpr auto members = SoaFields<Type>::members;
+
+	template<size_t J>
+	using Field = typename member_type<std::decay_t<std::tuple_element_t<J, decltype(SoaFields<Type>::members)>>>::type;
+	using Columns = std::tuple<Field<I>*...>;
+	//Bytes of one element across the columns
+	static constexpr u64 ROW_SIZE = (sizeof(Field<I>) + ... + 0);
+
+	static Type load(const Columns& columns, u32 position)
+	{
+		Type value{};
+		((value.*std::get<I>(members) = std::get<I>(columns)[position]), ...);
+		return value;
+	}
+
+	static void store(const Columns& columns, u32 position, const Type& value)
+	{
+		((std::get<I>(columns)[position] = value.*std::get<I>(members)), ...);
+	}
+
+	static void copy(const Columns& columns, u32 destination, u32 source)
+	{
+		((std::get<I>(columns)[destination] = std::get<I>(columns)[source]), ...);
+	}
+};
+
+//Stands in for Type& over the columns of a SoaSet, converts to a Type copy and
+//assigning a Type writes every field back. field<I>() references a single field
+template<typename Type>
+class SoaRef
+{
+	using Layout = SoaLayout<Type>;
+public:
+	SoaRef(const typename Layout::Columns& columns, u32 position) : columns{columns}, position{position} {}
+
+	operator Type() const
+	{
+		return Layout::load(columns, position);
+	}
+
+	const SoaRef& operator=(const Type& value) const
+	{
+		Layout::store(columns, position, value);
+		return *this;
+	}
+
+	template<size_t I>
+	auto& field() const
+	{
+		return std::get<I>(columns)[position];
+	}
+
+private:
+	const typename Layout::Columns& columns;
+	u32 position;
+};
+
+template<typename Type, typename Index>
+class SoaSet;
+
+template<typename Type, typename Index>
+class SoaIterator
+{
+	using Set = SoaSet<Type, Index>;
+public:
+	SoaIterator(const Set* set, u32 position) : set{set}, position{position} {}
+	SoaIterator(const SoaIterator&) = default;
+
+	SoaIterator& operator++()
+	{
+		++position;
+		return *this;
+	}
+
+	SoaIterator& operator--()
+	{
+		--position;
+		return *this;
+	}
+
+	bool operator==(const SoaIterator& other) const
+	{
+		return position == other.position;
+	}
+
+	bool operator!=(const SoaIterator& other) const
+	{
+		return position != other.position;
+	}
+
+	SoaRef<Type> operator*() const
+	{
+		return SoaRef<Type>{ set->columns, position };
+	}
+
+	Index index() const { return set->dense[position]; }
+	inline u32 _Get_Position() const { return position; }
+
+private:
+	const Set* set;
+	u32 position;
+};
+
+//Same indexing as SparseSet but every field listed in SoaFields<Type> gets its own
+//packed array aligned to a cache line, so a system can stream e.g. all x values with
+//vector instructions through column<I>(). Elements are accessed through SoaRef proxies
+template<typename Type, typename Index = u64>
+class SoaSet
+{
+	static_assert(std::is_integral_v<Index>, "Index needs to be of integral type");
+	static_assert(std::is_trivially_copyable_v<Type> && std::is_default_constructible_v<Type>,
+		"SoaSet components need to be trivially copyable and default constructible");
+	using Layout = SoaLayout<Type>;
+	friend class SoaIterator<Type, Index>;
+public:
+	using Iterator =            SoaIterator<Type, Index>;
+	using ConstIterator =       SoaIterator<Type, Index>;
+
+	static constexpr u32 COLUMN_ALIGN   = 64;
+
+public:
+	SoaSet() = default;
+	explicit SoaSet(MemoryResource& resource) : sparse{resource}, resource{&resource} {}
+	SoaSet(const SoaSet&) = delete;
+	SoaSet& operator=(const SoaSet&) = delete;
+
+	~SoaSet()
+	{
+		resource->deallocate_array(dense, capacity);
+		release_columns(columns);
+	}
+
+	template<class... Args>
+	SoaRef<Type> emplace(Index index, Args&&... args)
+	{
+		//Replace if exists
+		static_assert(std::is_constructible_v<Type, Args...>, "Type needs to be constructible with the given arguments");
+		if (contains(index))
+			erase(index);
+
+		if (count == capacity)
+			grow(capacity == 0 ? MIN_CAPACITY : capacity * 2);
+
+		sparse.assure(entity_index(index)) = count;
+		dense[count] = index;
+		Layout::store(columns, count, Type{ std::forward<Args>(args)... });
+		return SoaRef<Type>{ columns, count++ };
+	}
+
+	SoaRef<Type> insert(Index index, Type& value)
+	{
+		return emplace(index, value);
+	}
+
+	//Same contract as DenseMap::emplace_sorted, the columns grow once for the whole batch
+	template<class IndexIt, class... Args>
+	void emplace_sorted(IndexIt first, IndexIt last, const Args&... args)
+	{
+		static_assert(std::is_constructible_v<Type, const Args&...>, "Type needs to be constructible with the given arguments");
+		reserve(count + static_cast<u32>(last - first));
+		const Type value{ args... };
+		for (; first != last; ++first) {
+			assert(!contains(*first));
+			sparse.assure(entity_index(*first)) = count;
+			dense[count] = *first;
+			Layout::store(columns, count++, value);
+		}
+	}
+
+	//Same contract as DenseMap::insert_sorted
+	template<class IndexIt, class ValueIt>
+	void insert_sorted(IndexIt first, IndexIt last, ValueIt values)
+	{
+		reserve(count + static_cast<u32>(last - first));
+		for (; first != last; ++first, ++values) {
+			assert(!contains(*first));
+			sparse.assure(entity_index(*first)) = count;
+			dense[count] = *first;
+			Layout::store(columns, count++, *values);
+		}
+	}
+
+	void reserve(u32 new_capacity)
+	{
+		if (new_capacity > capacity)
+			grow(new_capacity);
+	}
+
+	SoaRef<Type> get_at(Index index)
+	{
+		const u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return SoaRef<Type>{ columns, position };
+	}
+
+	Type get_at(Index index) const
+	{
+		const u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return Layout::load(columns, position);
+	}
+
+	bool contains(Index index) const
+	{
+		return position_of(index) != NULL_POSITION;
+	}
+
+	void erase(Index index)
+	{
+		const u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		erase_at(position);
+	}
+
+	void erase(Iterator it)
+	{
+		erase_at(it._Get_Position());
+	}
+
+	//Keys not in the set are skipped
+	template<class IndexIt>
+	void erase_sorted(IndexIt first, IndexIt last)
+	{
+		for (; first != last; ++first) {
+			const u32 position = position_of(*first);
+			if (position != NULL_POSITION)
+				erase_at(position);
+		}
+	}
+
+	//Keeps the columns and the pages allocated
+	void clear()
+	{
+		for (u32 i = 0; i < count; i++)
+			sparse.assure(entity_index(dense[i])) = NULL_POSITION;
+
+		count = 0;
+	}
+
+	Iterator find(Index key)
+	{
+		const u32 position = position_of(key);
+		return position != NULL_POSITION ? Iterator{ this, position } : end();
+	}
+
+	ConstIterator find(Index key) const
+	{
+		const u32 position = position_of(key);
+		return position != NULL_POSITION ? ConstIterator{ this, position } : cend();
+	}
+
+	Iterator begin()
+	{
+		return Iterator{ this, 0 };
+	}
+
+	Iterator end()
+	{
+		return Iterator{ this, count };
+	}
+
+	Iterator cbegin() const
+	{
+		return Iterator{ this, 0 };
+	}
+
+	Iterator cend() const
+	{
+		return Iterator{ this, count };
+	}
+
+	SoaRef<Type> operator[](Index index)
+	{
+		const u32 position = position_of(index);
+		if (position == NULL_POSITION)
+			return emplace(index);
+
+		return SoaRef<Type>{ columns, position };
+	}
+
+	Type operator[](const Index index) const
+	{
+		return get_at(index);
+	}
+
+	//Same cuts as SparseSet::split
+	u32 split(Iterator* boundaries, u32 max_chunks)
+	{
+		const u32 chunks = max_chunks < count ? max_chunks : count;
+		for (u32 chunk = 0; chunk <= chunks; chunk++)
+			boundaries[chunk] = Iterator{ this, chunks == 0 ? 0 : static_cast<u32>(static_cast<u64>(count) * chunk / chunks) };
+
+		return chunks;
+	}
+
+	//Field I of every element in the order of keys(), aligned to COLUMN_ALIGN
+	template<size_t I>
+	FieldColumn<typename Layout::template Field<I>> column()
+	{
+		return FieldColumn<typename Layout::template Field<I>>{ std::get<I>(columns), count };
+	}
+
+	u32 size() const { return count; }
+	const Index* keys() const { return dense; }
+
+	ContainerStats memory_usage() const
+	{
+		return ContainerStats{ count, capacity, sparse.bytes_reserved() + static_cast<u64>(capacity) * sizeof(Index),
+			static_cast<u64>(capacity) * Layout::ROW_SIZE, 0 };
+	}
+
+private:
+	u32 position_of(Index index) const
+	{
+		const u32 position = sparse.find(entity_index(index));
+		return position != NULL_POSITION && dense[position] == index ? position : NULL_POSITION;
+	}
+
+	void erase_at(u32 position)
+	{
+		assert(position < count);
+		const u32 last = count - 1;
+		sparse.assure(entity_index(dense[position])) = NULL_POSITION;
+
+		//Swap and pop, the last element fills the hole
+		if (position != last) {
+			Layout::copy(columns, position, last);
+			dense[position] = dense[last];
+			sparse.assure(entity_index(dense[position])) = position;
+		}
+
+		--count;
+	}
+
+	void grow(u32 new_capacity)
+	{
+		Index* new_dense = resource->allocate_array<Index>(new_capacity);
+		if (dense != nullptr)
+			std::memcpy(new_dense, dense, sizeof(Index) * count);
+
+		typename Layout::Columns new_columns = columns;
+		std::apply([&](auto*&... column) { (reallocate(column, new_capacity), ...); }, new_columns);
+
+		resource->deallocate_array(dense, capacity);
+		release_columns(columns);
+		dense = new_dense;
+		columns = new_columns;
+		capacity = new_capacity;
+	}
+
+	//Points column at a new allocation holding the same count elements
+	template<typename Field>
+	void reallocate(Field*& column, u32 new_capacity)
+	{
+		Field* new_column = static_cast<Field*>(resource->allocate(sizeof(Field) * new_capacity, COLUMN_ALIGN));
+		if (column != nullptr)
+			std::memcpy(new_column, column, sizeof(Field) * count);
+
+		column = new_column;
+	}
+
+	void release_columns(typename Layout::Columns& released)
+	{
+		auto release = [&](auto* column) {
+			if (column != nullptr)
+				resource->deallocate(column, sizeof(*column) * capacity, COLUMN_ALIGN);
+		};
+		std::apply([&](auto*... column) { (release(column), ...); }, released);
+	}
+
+private:
+	static constexpr u32 MIN_CAPACITY   = 64;
+	static constexpr u32 NULL_POSITION  = SparsePages::NULL_POSITION;
+
+	SparsePages sparse;
+	MemoryResource* resource = &default_resource();
+
+	Index* dense = nullptr;
+	typename Layout::Columns columns{};
+	u32 count = 0, capacity = 0;
+};
@@ -0,0 +1,451 @@
+#pragma once
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <cstring>
+#include "types.h"
+#include "entity.h"
+#include "memory_resource.h"
+
+template<typename Type, typename Index>
+class SparseIterator
+{
+public:
+	SparseIterator(Index* keys, Type* values, u32 position) : keys{keys}, values{values}, position{position} {}
+	SparseIterator(const SparseIterator&) = default;
+
+	SparseIterator& operator++()
+	{
+		++position;
+		return *this;
+	}
+
+	SparseIterator& operator--()
+	{
+		--position;
+		return *this;
+	}
+
+	bool operator==(const SparseIterator& other) const
+	{
+		return position == other.position;
+	}
+
+	bool operator!=(const SparseIterator& other) const
+	{
+		return position != other.position;
+	}
+
+	Type& operator*()
+	{
+		return values[position];
+	}
+
+	Index index() const { return keys[position]; }
+	inline u32 _Get_Position() const { return position; }
+
+private:
+	Index* keys;
+	Type* values;
+	u32 position;
+};
+
+//Paged entity index -> dense position table, pages are allocated on first use
+class SparsePages
+{
+public:
+	static constexpr u32 NULL_POSITION  = 0xFFFFFFFF;
+
+	SparsePages() = default;
+	explicit SparsePages(MemoryResource& resource) : resource{&resource} {}
+	SparsePages(const SparsePages&) = delete;
+	SparsePages& operator=(const SparsePages&) = delete;
+
+	~SparsePages()
+	{
+		for (u32 i = 0; i < page_count; i++)
+			resource->deallocate_array(pages[i], PAGE_SIZE);
+
+		resource->deallocate_array(pages, page_count);
+	}
+
+	u32 find(u32 index) const
+	{
+		const u32 page = index / PAGE_SIZE;
+		if (page >= page_count || pages[page] == nullptr)
+			return NULL_POSITION;
+
+		return pages[page][index % PAGE_SIZE];
+	}
+
+	u32& assure(u32 index)
+	{
+		const u32 page = index / PAGE_SIZE;
+		if (page >= page_count) {
+			u32 new_count = page_count == 0 ? 1 : page_count;
+			while (new_count <= page) new_count *= 2;
+
+			u32** new_pages = resource->allocate_array<u32*>(new_count);
+			std::memset(new_pages, 0, sizeof(u32*) * new_count);
+			if (pages != nullptr)
+				std::memcpy(new_pages, pages, sizeof(u32*) * page_count);
+
+			resource->deallocate_array(pages, page_count);
+			pages = new_pages;
+			page_count = new_count;
+		}
+
+		if (pages[page] == nullptr) {
+			pages[page] = resource->allocate_array<u32>(PAGE_SIZE);
+			++used_pages;
+			//0xFF bytes spell NULL_POSITION
+			std::memset(pages[page], 0xFF, sizeof(u32) * PAGE_SIZE);
+		}
+
+		return pages[page][index % PAGE_SIZE];
+	}
+
+	//Pages and the table pointing at them
+	u64 bytes_reserved() const
+	{
+		return static_cast<u64>(used_pages) * PAGE_SIZE * sizeof(u32) + static_cast<u64>(page_count) * sizeof(u32*);
+	}
+
+private:
+	static constexpr u32 PAGE_SIZE      = 4096;
+
+	MemoryResource* resource = &default_resource();
+	u32** pages = nullptr;
+	u32 page_count = 0, used_pages = 0;
+};
+
+template<typename Type, typename Index>
+class SparseSet;
+
+template<typename Map>
+struct is_sparse_set : std::false_type {};
+
+template<typename Type, typename Index>
+struct is_sparse_set<SparseSet<Type, Index>> : std::true_type {};
+
+//Paged sparse index -> packed dense arrays, every operation is O(1) and the
+//components of a type are always contiguous in memory. Only the entity_index part
+//of a key addresses the pages, the full key is checked against the dense array
+//so a stale entity handle never matches the slot of the one that reused it
+template<typename Type, typename Index = u64>
+class SparseSet
+{
+	static_assert(std::is_integral_v<Index>, "Index needs to be of integral type");
+public:
+	using Iterator =            SparseIterator<Type, Index>;
+	using ConstIterator =       SparseIterator<Type, Index>;
+
+public:
+	SparseSet() = default;
+	explicit SparseSet(MemoryResource& resource) : sparse{resource}, resource{&resource} {}
+	SparseSet(const SparseSet&) = delete;
+	SparseSet& operator=(const SparseSet&) = delete;
+
+	~SparseSet()
+	{
+		for (u32 i = 0; i < count; i++)
+			packed[i].~Type();
+
+		release();
+	}
+
+	template<class... Args>
+	Type& emplace(Index index, Args&&... args)
+	{
+		//Replace if exists
+		static_assert(std::is_constructible_v<Type, Args...>, "Type needs to be constructible with the given arguments");
+		if (contains(index))
+			erase(index);
+
+		if (count == capacity)
+			grow_dense(capacity == 0 ? MIN_CAPACITY : capacity * 2);
+
+		assure_slot(index) = count;
+		dense[count] = index;
+		new (&packed[count]) Type{ std::forward<Args>(args)... };
+		return packed[count++];
+	}
+
+	Type& insert(Index index, Type& value)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		return emplace(index, std::move(value));
+	}
+
+	//Same contract as DenseMap::emplace_sorted, the dense arrays grow once for the whole batch
+	template<class IndexIt, class... Args>
+	void emplace_sorted(IndexIt first, IndexIt last, const Args&... args)
+	{
+		static_assert(std::is_constructible_v<Type, const Args&...>, "Type needs to be constructible with the given arguments");
+		reserve(count + static_cast<u32>(last - first));
+		for (; first != last; ++first) {
+			assert(!contains(*first));
+			assure_slot(*first) = count;
+			dense[count] = *first;
+			new (&packed[count++]) Type{ args... };
+		}
+	}
+
+	//Same contract as DenseMap::insert_sorted
+	template<class IndexIt, class ValueIt>
+	void insert_sorted(IndexIt first, IndexIt last, ValueIt values)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		reserve(count + static_cast<u32>(last - first));
+		for (; first != last; ++first, ++values) {
+			assert(!contains(*first));
+			assure_slot(*first) = count;
+			dense[count] = *first;
+			new (&packed[count++]) Type(std::move(*values));
+		}
+	}
+
+	void reserve(u32 new_capacity)
+	{
+		if (new_capacity > capacity)
+			grow_dense(new_capacity);
+	}
+
+	Type& get_at(Index index)
+	{
+		u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return packed[position];
+	}
+
+	const Type& get_at(Index index) const
+	{
+		u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return packed[position];
+	}
+
+	bool contains(Index index) const
+	{
+		return position_of(index) != NULL_POSITION;
+	}
+
+	void erase(Index index)
+	{
+		u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		erase_at(position);
+	}
+
+	void erase(Iterator it)
+	{
+		erase_at(it._Get_Position());
+	}
+
+	//Keys not in the set are skipped
+	template<class IndexIt>
+	void erase_sorted(IndexIt first, IndexIt last)
+	{
+		for (; first != last; ++first) {
+			const u32 position = position_of(*first);
+			if (position != NULL_POSITION)
+				erase_at(position);
+		}
+	}
+
+	//Keeps the dense arrays and the pages allocated
+	void clear()
+	{
+		for (u32 i = 0; i < count; i++) {
+			assure_slot(dense[i]) = NULL_POSITION;
+			packed[i].~Type();
+		}
+
+		count = 0;
+	}
+
+	Iterator find(Index key)
+	{
+		u32 position = position_of(key);
+		return position != NULL_POSITION ? Iterator{ dense, packed, position } : end();
+	}
+
+	ConstIterator find(Index key) const
+	{
+		u32 position = position_of(key);
+		return position != NULL_POSITION ? ConstIterator{ dense, packed, position } : cend();
+	}
+
+	Iterator begin()
+	{
+		return Iterator{ dense, packed, 0 };
+	}
+
+	Iterator end()
+	{
+		return Iterator{ dense, packed, count };
+	}
+
+	Iterator cbegin() const
+	{
+		return Iterator{ dense, packed, 0 };
+	}
+
+	Iterator cend() const
+	{
+		return Iterator{ dense, packed, count };
+	}
+
+	Type& operator[](Index index)
+	{
+		static_assert(std::is_default_constructible_v<Type>, "building objects without default constructors via the [] operator is not possible");
+		u32 position = position_of(index);
+		if (position == NULL_POSITION)
+			return emplace(index);
+
+		return packed[position];
+	}
+
+	const Type& operator[](const Index index) const
+	{
+		u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return packed[position];
+	}
+
+	//Cuts the dense arrays in at most max_chunks ranges of the same size, chunk i is
+	//[boundaries[i], boundaries[i + 1]) and boundaries needs room for max_chunks + 1 entries
+	u32 split(Iterator* boundaries, u32 max_chunks)
+	{
+		const u32 chunks = max_chunks < count ? max_chunks : count;
+		for (u32 chunk = 0; chunk <= chunks; chunk++)
+			boundaries[chunk] = Iterator{ dense, packed, chunks == 0 ? 0 : static_cast<u32>(static_cast<u64>(count) * chunk / chunks) };
+
+		return chunks;
+	}
+
+	//Exchanges the dense positions of two contained keys, their values move along
+	void swap(Index first, Index second)
+	{
+		const u32 first_position = position_of(first);
+		const u32 second_position = position_of(second);
+		assert(first_position != NULL_POSITION && second_position != NULL_POSITION);
+		if (first_position == second_position)
+			return;
+
+		std::swap(packed[first_position], packed[second_position]);
+		dense[first_position] = second;
+		dense[second_position] = first;
+		assure_slot(first) = second_position;
+		assure_slot(second) = first_position;
+	}
+
+	//Position of a contained key in the dense arrays
+	u32 index_of(Index index) const
+	{
+		const u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return position;
+	}
+
+	//Uses keys and values in place instead of copying them, e.g. the arrays of a mapped
+	//snapshot. They need to stay alive until the set is destroyed or grows, which moves
+	//the elements to memory of its own
+	void adopt(Index* keys, Type* values, u32 new_count)
+	{
+		static_assert(std::is_trivially_copyable_v<Type>, "only trivially copyable types can be adopted");
+		assert(count == 0);
+		release();
+		dense = keys;
+		packed = values;
+		count = capacity = new_count;
+		borrowed = true;
+
+		for (u32 i = 0; i < count; i++)
+			assure_slot(dense[i]) = i;
+	}
+
+	u32 size() const { return count; }
+
+	//Adopted arrays belong to someone else and are not counted
+	ContainerStats memory_usage() const
+	{
+		const u32 owned = borrowed ? 0 : capacity;
+		return ContainerStats{ count, capacity, sparse.bytes_reserved() + static_cast<u64>(owned) * sizeof(Index),
+			static_cast<u64>(owned) * sizeof(Type), 0 };
+	}
+
+	Type* data() { return packed; }
+	const Type* data() const { return packed; }
+	const Index* keys() const { return dense; }
+
+private:
+	u32 position_of(Index index) const
+	{
+		const u32 position = sparse.find(entity_index(index));
+		return position != NULL_POSITION && dense[position] == index ? position : NULL_POSITION;
+	}
+
+	u32& assure_slot(Index index)
+	{
+		return sparse.assure(entity_index(index));
+	}
+
+	void erase_at(u32 position)
+	{
+		assert(position < count);
+		const u32 last = count - 1;
+		assure_slot(dense[position]) = NULL_POSITION;
+		packed[position].~Type();
+
+		//Swap and pop, the last element fills the hole
+		if (position != last) {
+			new (&packed[position]) Type(std::move(packed[last]));
+			packed[last].~Type();
+			dense[position] = dense[last];
+			assure_slot(dense[position]) = position;
+		}
+
+		--count;
+	}
+
+	void grow_dense(u32 new_capacity)
+	{
+		Index* new_dense = resource->allocate_array<Index>(new_capacity);
+		Type* new_packed = resource->allocate_array<Type>(new_capacity);
+
+		for (u32 i = 0; i < count; i++) {
+			new_dense[i] = dense[i];
+			new (&new_packed[i]) Type(std::move(packed[i]));
+			packed[i].~Type();
+		}
+
+		release();
+		dense = new_dense;
+		packed = new_packed;
+		capacity = new_capacity;
+	}
+
+	//Frees the dense arrays unless they were adopted
+	void release()
+	{
+		if (!borrowed) {
+			resource->deallocate_array(dense, capacity);
+			resource->deallocate_array(packed, capacity);
+		}
+
+		borrowed = false;
+	}
+
+private:
+	static constexpr u32 MIN_CAPACITY   = 64;
+	static constexpr u32 NULL_POSITION  = SparsePages::NULL_POSITION;
+
+	SparsePages sparse;
+	MemoryResource* resource = &default_resource();
+
+	Index* dense = nullptr;
+	Type* packed = nullptr;
+	u32 count = 0, capacity = 0;
+	bool borrowed = false;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "types.h"
+
+//Per thread lookup of the state a thread keeps in objects shared by several threads, e.g. the
+//create_concurrent block of an EntityPool or the CommandBuffer of a CommandQueue. Each of them
+//owns a Key, the entry of the Key used last is kept in front. A miss drops the entries of the
+//destroyed owners before adding its own, so a thread only lists the owners alive at its last miss
+template<class Value>
+class ThreadLocalCache
+{
+public:
+	class Key
+	{
+	public:
+		Key() : id{ next_id++ }, alive{ std::make_shared<u8>() } {}
+		Key(const Key&) = delete;
+		Key& operator=(const Key&) = delete;
+
+	private:
+		friend class ThreadLocalCache;
+
+		//Never reused, stale entries can never match a new owner
+		const u64 id;
+		std::shared_ptr<u8> alive;
+	};
+
+	//Value of key for the calling thread, make() returns it on the first call of each thread
+	template<class Make>
+	static Value& get(const Key& key, Make&& make)
+	{
+		std::vector<Entry>& entries = local_entries;
+		if (!entries.empty() && entries.front().id == key.id)
+			return *entries.front().value;
+
+		for (Entry& entry : entries) {
+			if (entry.id == key.id) {
+				std::swap(entry, entries.front());
+				return *entries.front().value;
+			}
+		}
+
+		entries.erase(std::remove_if(entries.begin(), entries.end(), [](const Entry& entry) { return entry.owner.expired(); }), entries.end());
+		Value& value = make();
+		entries.push_back(Entry{ key.id, key.alive, &value });
+		std::swap(entries.front(), entries.back());
+		return value;
+	}
+
+private:
+	struct Entry
+	{
+		u64 id;
+		std::weak_ptr<u8> owner;
+		Value* value;
+	};
+
+	static inline std::atomic<u64> next_id{ 0 };
+	static inline thread_local std::vector<Entry> local_entries;
+};
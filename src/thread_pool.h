@@ -0,0 +1,181 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "types.h"
+
+//Fixed set of workers, each with its own task deque. A worker pops the newest
+//task of its own deque and when empty steals the oldest one of another worker
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+
+	explicit ThreadPool(u32 thread_count = std::thread::hardware_concurrency())
+		: queues(thread_count == 0 ? 1 : thread_count)
+	{
+		workers.reserve(queues.size());
+		for (u32 index = 0; index < queues.size(); index++)
+			workers.emplace_back([this, index]() { worker_loop(index); });
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ sleep_mutex };
+			stopping = true;
+		}
+
+		sleep_condition.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	//Tasks submitted from a worker go to its own deque, the others are spread round robin.
+	//remaining is incremented now and decremented once the task has run
+	void submit(Task task, std::atomic<u32>& remaining)
+	{
+		remaining.fetch_add(1, std::memory_order_relaxed);
+		const u32 target = current_pool == this ? current_worker : next_queue++ % static_cast<u32>(queues.size());
+		{
+			//queued is counted before the queue lock is released, take cannot pop the task earlier
+			std::lock_guard<std::mutex> lock{ queues[target].mutex };
+			queues[target].tasks.push_back([this, task = std::move(task), &remaining]() {
+				task();
+				finish(remaining);
+			});
+			queued.fetch_add(1);
+		}
+
+		//Sleepers count themselves before checking queued, so with none counted nobody can miss the task.
+		//Threads in wait help with the new task too
+		if (sleeping.load() != 0) {
+			{
+				std::lock_guard<std::mutex> lock{ sleep_mutex };
+			}
+
+			sleep_condition.notify_one();
+			idle_condition.notify_all();
+		}
+	}
+
+	//Returns once remaining drops to zero, the calling thread runs queued tasks meanwhile
+	//so waiting from inside a task (nested parallelism) cannot starve the pool
+	void wait(const std::atomic<u32>& remaining)
+	{
+		const u32 start = current_pool == this ? current_worker : 0;
+		while (remaining.load(std::memory_order_acquire) != 0) {
+			Task task;
+			if (take(start, task)) {
+				task();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock{ sleep_mutex };
+			sleeping.fetch_add(1);
+			idle_condition.wait(lock, [&]() { return remaining.load(std::memory_order_acquire) == 0 || queued.load() != 0; });
+			sleeping.fetch_sub(1);
+		}
+	}
+
+	//Runs func(0) ... func(count - 1) on the pool and waits for all of them
+	template<class Func>
+	void parallel_for(u32 count, Func&& func)
+	{
+		std::atomic<u32> remaining{0};
+		for (u32 index = 0; index < count; index++)
+			submit([&func, index]() { func(index); }, remaining);
+
+		wait(remaining);
+	}
+
+	u32 size() const
+	{
+		return static_cast<u32>(queues.size());
+	}
+
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void worker_loop(u32 index)
+	{
+		current_pool = this;
+		current_worker = index;
+
+		for (;;) {
+			Task task;
+			if (take(index, task)) {
+				task();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock{ sleep_mutex };
+			sleeping.fetch_add(1);
+			sleep_condition.wait(lock, [this]() { return stopping || queued.load() != 0; });
+			sleeping.fetch_sub(1);
+			if (stopping && queued.load() == 0)
+				return;
+		}
+	}
+
+	bool take(u32 own, Task& task)
+	{
+		const u32 count = static_cast<u32>(queues.size());
+		for (u32 offset = 0; offset < count; offset++) {
+			WorkQueue& queue = queues[(own + offset) % count];
+			std::lock_guard<std::mutex> lock{ queue.mutex };
+			if (queue.tasks.empty())
+				continue;
+
+			if (offset == 0) {
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else {
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+
+			queued.fetch_sub(1);
+			return true;
+		}
+
+		return false;
+	}
+
+	void finish(std::atomic<u32>& remaining)
+	{
+		if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			std::lock_guard<std::mutex> lock{ sleep_mutex };
+			idle_condition.notify_all();
+		}
+	}
+
+private:
+	std::vector<WorkQueue> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_condition, idle_condition;
+	//Tasks in all deques, only changed under the lock of the deque holding the task
+	std::atomic<u32> queued{0};
+	//Threads parked in worker_loop or wait
+	std::atomic<u32> sleeping{0};
+	bool stopping = false;
+
+	std::atomic<u32> next_queue{0};
+
+	static inline thread_local ThreadPool* current_pool = nullptr;
+	static inline thread_local u32 current_worker = 0;
+};
@@ -0,0 +1,327 @@
+#pragma once
+#include <new>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include "types.h"
+#include "entity.h"
+#include "arena.h"
+#include "sparse_set.h"
+#include "component_ticks.h"
+
+template<typename Type>
+struct TransientChunk
+{
+	static constexpr u32 SIZE = 256;
+
+	u64 keys[SIZE];
+	ComponentTicks ticks[SIZE];
+	alignas(Type) u8 content[sizeof(Type) * SIZE];
+
+	Type& value(u32 offset) { return *std::launder(reinterpret_cast<Type*>(content) + offset); }
+};
+
+template<typename Type>
+class TransientIterator
+{
+	using Chunk = TransientChunk<Type>;
+public:
+	TransientIterator(Chunk* const* chunks, u32 position) : chunks{chunks}, position{position} {}
+	TransientIterator(const TransientIterator&) = default;
+
+	TransientIterator& operator++()
+	{
+		++position;
+		return *this;
+	}
+
+	TransientIterator& operator--()
+	{
+		--position;
+		return *this;
+	}
+
+	bool operator==(const TransientIterator& other) const
+	{
+		return position == other.position;
+	}
+
+	bool operator!=(const TransientIterator& other) const
+	{
+		return position != other.position;
+	}
+
+	Type& operator*()
+	{
+		return chunks[position / Chunk::SIZE]->value(position % Chunk::SIZE);
+	}
+
+	u64 index() const { return chunks[position / Chunk::SIZE]->keys[position % Chunk::SIZE]; }
+	inline u32 _Get_Position() const { return position; }
+
+private:
+	Chunk* const* chunks;
+	u32 position;
+};
+
+//Components living until the end of the frame, see Registry::end_frame. The dense arrays are
+//chunks carved from the registry arena, so an insertion is a pointer bump once per chunk and
+//clear() only drops the chunk list: the sparse pages are left stale and every lookup checks
+//the key against the dense array, like SparseSet does for reused slots. Trivially destructible
+//types cost nothing to clear, the others have their destructors run. The values never move
+//while the frame lasts, besides the swap and pop of an erasure. The registry ticks of every
+//component sit in its chunk too, so a transient component never touches the heap
+template<typename Type>
+class TransientSet
+{
+	static_assert(alignof(Type) <= 64, "transient components are limited to the arena alignment");
+	using Chunk =               TransientChunk<Type>;
+public:
+	using Iterator =            TransientIterator<Type>;
+	using ConstIterator =       TransientIterator<Type>;
+
+public:
+	//The chunks come from arena, the sparse pages from resource
+	TransientSet(MonotonicArena& arena, MemoryResource& resource) : arena{arena}, sparse{resource} {}
+	TransientSet(const TransientSet&) = delete;
+	TransientSet& operator=(const TransientSet&) = delete;
+
+	~TransientSet()
+	{
+		clear();
+	}
+
+	template<class... Args>
+	Type& emplace(u64 index, Args&&... args)
+	{
+		//Replace if exists
+		static_assert(std::is_constructible_v<Type, Args...>, "Type needs to be constructible with the given arguments");
+		u32 position = position_of(index);
+		if (position != NULL_POSITION) {
+			value_at(position).~Type();
+		}
+		else {
+			position = push(index);
+		}
+
+		new (&value_at(position)) Type{ std::forward<Args>(args)... };
+		return value_at(position);
+	}
+
+	Type& insert(u64 index, Type& value)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		return emplace(index, std::move(value));
+	}
+
+	//Same contract as DenseMap::emplace_sorted
+	template<class IndexIt, class... Args>
+	void emplace_sorted(IndexIt first, IndexIt last, const Args&... args)
+	{
+		static_assert(std::is_constructible_v<Type, const Args&...>, "Type needs to be constructible with the given arguments");
+		for (; first != last; ++first) {
+			assert(!contains(*first));
+			new (&value_at(push(*first))) Type{ args... };
+		}
+	}
+
+	//Same contract as DenseMap::insert_sorted
+	template<class IndexIt, class ValueIt>
+	void insert_sorted(IndexIt first, IndexIt last, ValueIt values)
+	{
+		static_assert(std::is_move_constructible_v<Type>, "Type needs to be move constructible");
+		for (; first != last; ++first, ++values) {
+			assert(!contains(*first));
+			new (&value_at(push(*first))) Type(std::move(*values));
+		}
+	}
+
+	Type& get_at(u64 index)
+	{
+		const u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return value_at(position);
+	}
+
+	const Type& get_at(u64 index) const
+	{
+		const u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return value_at(position);
+	}
+
+	//Left to the caller to fill once the component is added
+	ComponentTicks& ticks_at(u64 index)
+	{
+		const u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		return stamp_at(position);
+	}
+
+	const ComponentTicks* find_ticks(u64 index) const
+	{
+		const u32 position = position_of(index);
+		return position != NULL_POSITION ? &stamp_at(position) : nullptr;
+	}
+
+	bool contains(u64 index) const
+	{
+		return position_of(index) != NULL_POSITION;
+	}
+
+	void erase(u64 index)
+	{
+		const u32 position = position_of(index);
+		assert(position != NULL_POSITION);
+		erase_at(position);
+	}
+
+	void erase(Iterator it)
+	{
+		erase_at(it._Get_Position());
+	}
+
+	//Keys not in the set are skipped
+	template<class IndexIt>
+	void erase_sorted(IndexIt first, IndexIt last)
+	{
+		for (; first != last; ++first) {
+			const u32 position = position_of(*first);
+			if (position != NULL_POSITION)
+				erase_at(position);
+		}
+	}
+
+	//The chunks stay in the arena until it is reset
+	void clear()
+	{
+		if constexpr (!std::is_trivially_destructible_v<Type>) {
+			for (u32 i = 0; i < count; i++)
+				value_at(i).~Type();
+		}
+
+		chunks.clear();
+		count = 0;
+	}
+
+	u32 size() const
+	{
+		return count;
+	}
+
+	//The chunks are counted here although the frame arena owns them, the ticks with the keys
+	ContainerStats memory_usage() const
+	{
+		const u64 chunk_count = chunks.size();
+		return ContainerStats{ count, chunk_count * Chunk::SIZE, sparse.bytes_reserved() + chunk_count * (sizeof(Chunk::keys) + sizeof(Chunk::ticks)),
+			chunk_count * sizeof(Chunk::content), 0 };
+	}
+
+	//Same cuts as SparseSet::split
+	u32 split(Iterator* boundaries, u32 max_chunks)
+	{
+		const u32 parts = max_chunks < count ? max_chunks : count;
+		for (u32 part = 0; part <= parts; part++)
+			boundaries[part] = Iterator{ chunks.data(), parts == 0 ? 0 : static_cast<u32>(static_cast<u64>(count) * part / parts) };
+
+		return parts;
+	}
+
+	Iterator find(u64 key)
+	{
+		const u32 position = position_of(key);
+		return position != NULL_POSITION ? Iterator{ chunks.data(), position } : end();
+	}
+
+	ConstIterator find(u64 key) const
+	{
+		const u32 position = position_of(key);
+		return position != NULL_POSITION ? ConstIterator{ chunks.data(), position } : cend();
+	}
+
+	Iterator begin()
+	{
+		return Iterator{ chunks.data(), 0 };
+	}
+
+	Iterator end()
+	{
+		return Iterator{ chunks.data(), count };
+	}
+
+	Iterator cbegin() const
+	{
+		return Iterator{ chunks.data(), 0 };
+	}
+
+	Iterator cend() const
+	{
+		return Iterator{ chunks.data(), count };
+	}
+
+	Type& operator[](u64 index)
+	{
+		static_assert(std::is_default_constructible_v<Type>, "building objects without default constructors via the [] operator is not possible");
+		const u32 position = position_of(index);
+		return position != NULL_POSITION ? value_at(position) : emplace(index);
+	}
+
+	const Type& operator[](const u64 index) const
+	{
+		return get_at(index);
+	}
+
+private:
+	u64& key_at(u32 position) const { return chunks[position / Chunk::SIZE]->keys[position % Chunk::SIZE]; }
+	Type& value_at(u32 position) const { return chunks[position / Chunk::SIZE]->value(position % Chunk::SIZE); }
+	ComponentTicks& stamp_at(u32 position) const { return chunks[position / Chunk::SIZE]->ticks[position % Chunk::SIZE]; }
+
+	u32 position_of(u64 index) const
+	{
+		const u32 position = sparse.find(entity_index(index));
+		return position < count && key_at(position) == index ? position : NULL_POSITION;
+	}
+
+	//Claims the next dense position for index, the caller constructs the value
+	u32 push(u64 index)
+	{
+		if (count == chunks.size() * Chunk::SIZE)
+			chunks.push_back(arena.template allocate<Chunk>());
+
+		sparse.assure(entity_index(index)) = count;
+		key_at(count) = index;
+		return count++;
+	}
+
+	void erase_at(u32 position)
+	{
+		assert(position < count);
+		const u32 last = count - 1;
+		value_at(position).~Type();
+
+		//Swap and pop, the last element fills the hole
+		if (position != last) {
+			new (&value_at(position)) Type(std::move(value_at(last)));
+			value_at(last).~Type();
+			key_at(position) = key_at(last);
+			stamp_at(position) = stamp_at(last);
+			sparse.assure(entity_index(key_at(position))) = position;
+		}
+
+		--count;
+	}
+
+private:
+	static constexpr u32 NULL_POSITION  = SparsePages::NULL_POSITION;
+
+	MonotonicArena& arena;
+	std::vector<Chunk*> chunks;
+	SparsePages sparse;
+	u32 count = 0;
+};
+
+template<typename Map>
+struct is_transient_set : std::false_type {};
+
+template<typename Type>
+struct is_transient_set<TransientSet<Type>> : std::true_type {};
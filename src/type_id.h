@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <string_view>
+#include "types.h"
+
+//Simple yet pretty effective for our needs algorithm
+constexpr static u64 string_hash(const char* str, u32 size)
+{
+	//Random prime number
+	u64 hash = 11447;
+
+	for(u32 i = 0; i < size; i++) {
+		hash = (hash << 5) + hash + str[i];
+	}
+
+	return hash;
+}
+
+//Hash of the compiler generated signature, which spells out Type, computed at compile time
+template<class Type>
+constexpr static u64 type_hash()
+{
+#if defined(_MSC_VER)
+	return string_hash(__FUNCSIG__, sizeof(__FUNCSIG__) - 1);
+#else
+	return string_hash(__PRETTY_FUNCTION__, sizeof(__PRETTY_FUNCTION__) - 1);
+#endif
+}
+
+//Type as the compiler spells it, cut out of the same signature, e.g. for reports
+template<class Type>
+inline std::string_view type_name()
+{
+#if defined(_MSC_VER)
+	const std::string_view signature = __FUNCSIG__;
+	const size_t first = signature.find("type_name<") + 10;
+	const size_t last = signature.rfind(">(void)");
+#else
+	const std::string_view signature = __PRETTY_FUNCTION__;
+	const size_t first = signature.find("Type = ") + 7;
+	const size_t last = signature.find_first_of(";]", first);
+#endif
+	return signature.substr(first, last - first);
+}
+
+inline u32 next_type_index()
+{
+	static std::atomic<u32> counter{0};
+	return counter++;
+}
+
+//Dense index of Type, assigned the first time the type is used and valid for the
+//whole program, Registry resolves its storages by indexing an array with it
+template<class Type>
+inline u32 type_index()
+{
+	static const u32 index = next_type_index();
+	return index;
+}